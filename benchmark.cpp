@@ -0,0 +1,175 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <benchmark.h>
+#include <encoding.h>
+
+using namespace volo;
+
+// load_quark keys the number (counting from one) of the load which requested
+// a resource.
+static GQuark load_quark() {
+	static const auto quark = g_quark_from_static_string("volo-benchmark-load");
+	return quark;
+}
+
+void latency_samples::append_json(std::string& out) const {
+	auto sorted = samples;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&sorted](unsigned int p) {
+		return sorted.empty() ? 0 : sorted[(sorted.size() - 1) * p / 100];
+	};
+	gint64 sum = 0;
+	for (auto s : sorted) {
+		sum += s;
+	}
+
+	char buf[192];
+	snprintf(buf, sizeof(buf), "{\"count\":%zu,\"mean\":%.1f,\"p50\":%lld,\"p90\":%lld,"
+		"\"p99\":%lld,\"max\":%lld}", sorted.size(),
+		sorted.empty() ? 0.0 : double(sum) / sorted.size(),
+		static_cast<long long>(percentile(50)), static_cast<long long>(percentile(90)),
+		static_cast<long long>(percentile(99)), static_cast<long long>(percentile(100)));
+	out += buf;
+}
+
+uint64_t volo::resident_size() {
+	char buf[128];
+	auto fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return 0;
+	}
+	auto n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	unsigned long long size, resident;
+	if (n <= 0) {
+		return 0;
+	}
+	buf[n] = '\0';
+	if (sscanf(buf, "%llu %llu", &size, &resident) != 2) {
+		return 0;
+	}
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+void volo::append_benchmark_json(std::string& out, const char *uri,
+	unsigned int max_live_views, const std::vector<tab_benchmark_run>& runs) {
+
+	out += "{\"uri\":";
+	append_json_string(out, uri);
+	out += ",\"max_live_views\":";
+	out += std::to_string(max_live_views);
+	out += ",\"runs\":[";
+	for (auto& r : runs) {
+		if (&r != &runs.front()) {
+			out += ',';
+		}
+		out += "{\"tabs\":";
+		out += std::to_string(r.tabs);
+		out += ",\"open_us\":";
+		r.open.append_json(out);
+		out += ",\"switch_us\":";
+		r.show.append_json(out);
+		out += ",\"close_us\":";
+		r.close.append_json(out);
+		out += ",\"rss_open\":";
+		out += std::to_string(r.rss_open);
+		out += ",\"rss_closed\":";
+		out += std::to_string(r.rss_closed);
+		out += '}';
+	}
+	out += "]}\n";
+}
+
+load_benchmark::load_benchmark(webkit::web_context& context,
+	webkit::user_content_manager& filters, const char *uri, unsigned int count) :
+
+	empty_manager{webkit::user_content_manager::create()},
+	window{gtk::make_sunk<gtk::window>()},
+	box{gtk::make_sunk<gtk::box>(GTK_ORIENTATION_HORIZONTAL, 0)},
+	filtered{gtk::make_sunk<webkit::web_view>(&context, &filters)},
+	unfiltered{gtk::make_sunk<webkit::web_view>(&context, empty_manager.get())},
+	uri{uri},
+	count{count} {
+
+	window->set_title("volo load benchmark");
+	window->set_default_size(1600, 900);
+	box->pack_start(*filtered);
+	box->pack_start(*unfiltered);
+	window->add(*box);
+	filtered->connect_load_changed(*this, on_load_changed);
+	unfiltered->connect_load_changed(*this, on_load_changed);
+	filtered->connect_resource_load_started(*this, on_resource_load_started);
+	unfiltered->connect_resource_load_started(*this, on_resource_load_started);
+}
+
+void load_benchmark::run(std::function<void(const std::string&)> f) {
+	done = std::move(f);
+	window->show_all();
+	load_next();
+}
+
+void load_benchmark::load_next() {
+	if (loaded == 2 * count) {
+		std::string out;
+		out += "{\"uri\":";
+		append_json_string(out, uri.c_str());
+		out += ",\"loads\":";
+		out += std::to_string(count);
+		out += ",\"filtered_us\":";
+		filtered_loads.append_json(out);
+		out += ",\"unfiltered_us\":";
+		unfiltered_loads.append_json(out);
+		out += ",\"filtered_bytes\":";
+		filtered_bytes.append_json(out);
+		out += ",\"unfiltered_bytes\":";
+		unfiltered_bytes.append_json(out);
+		out += "}\n";
+		done(out);
+		return;
+	}
+	loading = loaded % 2 ? unfiltered.get() : filtered.get();
+	started = g_get_monotonic_time();
+	received = 0;
+	loading->load_uri(uri);
+}
+
+void load_benchmark::on_load_changed(webkit::web_view& wv, WebKitLoadEvent load_event) {
+	if (&wv != loading || load_event != WEBKIT_LOAD_FINISHED) {
+		return;
+	}
+	auto is_filtered = loading == filtered.get();
+	(is_filtered ? filtered_loads : unfiltered_loads).add(g_get_monotonic_time() - started);
+	(is_filtered ? filtered_bytes : unfiltered_bytes).add(received);
+	loading = nullptr;
+	++loaded;
+	// The next load begins once this signal has been handled.
+	gtk::idle_add(G_PRIORITY_DEFAULT_IDLE, *this, on_next_idle);
+}
+
+// on_resource_load_started counts the data received for each resource of the
+// current load.  Resources are tagged with the load which requested them, so
+// data still arriving for an earlier load is not counted.
+void load_benchmark::on_resource_load_started(webkit::web_view& wv, WebKitWebResource& resource) {
+	if (&wv != loading) {
+		return;
+	}
+	g_object_set_qdata(G_OBJECT(&resource), load_quark(), GSIZE_TO_POINTER(loaded + 1));
+	g_signal_connect(&resource, "received-data", G_CALLBACK(
+		static_cast<void (*)(WebKitWebResource *, guint64, gpointer)>(on_received_data)),
+		this);
+}
+
+void load_benchmark::on_received_data(WebKitWebResource& resource, guint64 length) {
+	auto load = GPOINTER_TO_SIZE(g_object_get_qdata(G_OBJECT(&resource), load_quark()));
+	if (loading && load == loaded + 1) {
+		received += length;
+	}
+}
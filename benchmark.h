@@ -0,0 +1,131 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_BENCHMARK_H
+#define _VOLO_BENCHMARK_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include <gtk.h>
+#include <stall_monitor.h>
+#include <webkit.h>
+
+namespace volo {
+
+// latency_samples collects the durations (in microseconds) of repetitions
+// of a single operation.
+class latency_samples {
+private:
+	std::vector<gint64> samples;
+
+public:
+	void add(gint64 duration) { samples.push_back(duration); }
+
+	// append_json appends a JSON object with the number of samples and
+	// their mean, median, 90th and 99th percentile and maximum, in the
+	// samples' units (microseconds, for latencies).
+	void append_json(std::string&) const;
+};
+
+// tab_benchmark_run holds the measurements of one benchmark run with a
+// number of tabs open.  Memory is the resident size of this (UI) process, in
+// bytes, once every tab was opened and shown, and again once the tabs were
+// closed.
+struct tab_benchmark_run {
+	unsigned int tabs{0};
+	latency_samples open;
+	latency_samples show;
+	latency_samples close;
+	uint64_t rss_open{0};
+	uint64_t rss_closed{0};
+};
+
+// resident_size returns the resident set size of this process, in bytes, or
+// zero if it cannot be read.
+uint64_t resident_size();
+
+// append_benchmark_json appends the runs of a benchmark as a JSON document,
+// along with the page loaded by each tab and the live view limit in effect.
+void append_benchmark_json(std::string&, const char *uri, unsigned int max_live_views,
+	const std::vector<tab_benchmark_run>&);
+
+// load_benchmark times loads of a page with and without content blocking.
+// The page is loaded in two web_views, one created with the content
+// blocker's user content manager and one with an empty one, alternating
+// between them so both see the same network and cache conditions.  Each load
+// is timed from its request until it finishes or fails, and the bytes
+// received for every resource it requests are counted.
+class load_benchmark {
+private:
+	using manager_ptr = gtk::unique_ptr<webkit::user_content_manager,
+		gtk::unref_delete<webkit::user_content_manager>>;
+
+	manager_ptr empty_manager;
+	gtk::unique_ptr<gtk::window> window;
+	gtk::unique_ptr<gtk::box> box;
+	gtk::unique_ptr<webkit::web_view> filtered;
+	gtk::unique_ptr<webkit::web_view> unfiltered;
+	std::string uri;
+	unsigned int count;
+	unsigned int loaded{0};
+	webkit::web_view *loading{nullptr};
+	gint64 started{0};
+	gint64 received{0};
+	latency_samples filtered_loads;
+	latency_samples unfiltered_loads;
+	latency_samples filtered_bytes;
+	latency_samples unfiltered_bytes;
+	std::function<void(const std::string&)> done;
+
+public:
+	// The page at uri is loaded count times in each web_view, created
+	// in context.
+	load_benchmark(webkit::web_context&, webkit::user_content_manager& filters,
+		const char *uri, unsigned int count);
+
+	load_benchmark(const load_benchmark&) = delete;
+	load_benchmark& operator=(const load_benchmark&) = delete;
+
+	// run shows the web_views and begins loading, calling done with the
+	// results as a JSON document once every load has finished.
+	void run(std::function<void(const std::string&)> done);
+
+private:
+	void load_next();
+	void on_load_changed(webkit::web_view&, WebKitLoadEvent);
+	void on_resource_load_started(webkit::web_view&, WebKitWebResource&);
+	void on_received_data(WebKitWebResource&, guint64);
+
+	// Slots (static functions)
+	static void on_load_changed(webkit::web_view *wv, WebKitLoadEvent load_event,
+		load_benchmark *b) {
+
+		slot_timer t{"load_benchmark::on_load_changed"};
+		b->on_load_changed(*wv, load_event);
+	}
+	static void on_resource_load_started(webkit::web_view *wv, WebKitWebResource *r,
+		WebKitURIRequest *, load_benchmark *b) {
+
+		slot_timer t{"load_benchmark::on_resource_load_started"};
+		b->on_resource_load_started(*wv, *r);
+	}
+	static void on_received_data(WebKitWebResource *r, guint64 length, gpointer b) {
+		slot_timer t{"load_benchmark::on_received_data"};
+		static_cast<load_benchmark *>(b)->on_received_data(*r, length);
+	}
+	static gboolean on_next_idle(load_benchmark *b) {
+		slot_timer t{"load_benchmark::on_next_idle"};
+		b->load_next();
+		return G_SOURCE_REMOVE;
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_BENCHMARK_H
@@ -0,0 +1,150 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <cache.h>
+
+using namespace volo;
+
+// Interval, in seconds, between measurements of the disk cache.
+const unsigned int measure_interval = 5 * 60;
+
+// An oversized disk cache is trimmed to this fraction of the size limit, so
+// that it is not trimmed again at every measurement.
+const double trim_ratio = 0.8;
+
+// Script counting the resources of a page (including the document itself)
+// served from the cache, fetched from the network, and of unknown origin,
+// separated by spaces.
+static const char timing_script[] =
+	"(function() {"
+	"  var hits = 0, misses = 0, unknown = 0;"
+	"  performance.getEntriesByType('navigation')"
+	"    .concat(performance.getEntriesByType('resource'))"
+	"    .forEach(function(e) {"
+	"      if (e.transferSize > 0) misses++;"
+	"      else if (e.decodedBodySize > 0) hits++;"
+	"      else unknown++;"
+	"    });"
+	"  return hits + ' ' + misses + ' ' + unknown;"
+	"})()";
+
+// Isolated script world of timing_script, whose builtins and DOM wrappers
+// the page cannot replace to forge the counts.
+static const char script_world[] = "volo-cache-monitor";
+
+cache_monitor::cache_monitor(webkit::website_data_manager& manager, const cache_policy& policy) :
+	manager{manager},
+	policy{policy},
+	measure_source{gtk::timeout_add_seconds(measure_interval, *this, on_measure_timeout)} {}
+
+cache_monitor::~cache_monitor() {
+	g_source_remove(measure_source);
+}
+
+void cache_monitor::append_stats(std::string& out) const {
+	// The hit rate is of the resources whose timing was visible.
+	auto known = counters.hits + counters.misses;
+	char line[128];
+	snprintf(line, sizeof(line), "%lu %lu %lu %.1f %llu %u %lu\n",
+		counters.hits, counters.misses, counters.unknown,
+		known ? 100.0 * counters.hits / known : 0.0,
+		static_cast<unsigned long long>(counters.disk_usage),
+		counters.sites, counters.evictions);
+	out += "# cache hits misses unknown hit_percent disk_bytes sites evictions\n";
+	out += line;
+}
+
+void cache_monitor::measure() {
+	if (measuring) {
+		return;
+	}
+	measuring = true;
+	webkit_website_data_manager_fetch(manager.ptr(), WEBKIT_WEBSITE_DATA_DISK_CACHE,
+		nullptr, on_fetched, this);
+}
+
+bool cache_monitor::on_measure_timeout() {
+	measure();
+	return G_SOURCE_CONTINUE;
+}
+
+void cache_monitor::on_fetched(GAsyncResult *result) {
+	measuring = false;
+	GError *error = nullptr;
+	auto list = webkit_website_data_manager_fetch_finish(manager.ptr(), result, &error);
+	if (error) {
+		g_warning("volo: measuring disk cache: %s", error->message);
+		g_error_free(error);
+		return;
+	}
+
+	std::vector<std::pair<uint64_t, WebKitWebsiteData *>> sites;
+	uint64_t total = 0;
+	for (auto l = list; l; l = l->next) {
+		auto data = static_cast<WebKitWebsiteData *>(l->data);
+		auto size = webkit_website_data_get_size(data, WEBKIT_WEBSITE_DATA_DISK_CACHE);
+		total += size;
+		sites.emplace_back(size, data);
+	}
+	counters.sites = sites.size();
+
+	if (policy.max_disk_size && total > policy.max_disk_size) {
+		// WebKit records no access times, so the data of the sites
+		// using the most space is removed first.
+		std::sort(sites.begin(), sites.end(), [](auto& a, auto& b) { return a.first > b.first; });
+		auto target = static_cast<uint64_t>(policy.max_disk_size * trim_ratio);
+		GList *evicted = nullptr;
+		for (auto& site : sites) {
+			if (total <= target) {
+				break;
+			}
+			evicted = g_list_prepend(evicted, site.second);
+			total -= site.first;
+			--counters.sites;
+			++counters.evictions;
+		}
+		// The list is copied before remove returns.
+		webkit_website_data_manager_remove(manager.ptr(), WEBKIT_WEBSITE_DATA_DISK_CACHE,
+			evicted, nullptr, on_removed, this);
+		g_list_free(evicted);
+	}
+	counters.disk_usage = total;
+	g_list_free_full(list, reinterpret_cast<GDestroyNotify>(webkit_website_data_unref));
+}
+
+void cache_monitor::on_removed(GAsyncResult *result) {
+	GError *error = nullptr;
+	if (!webkit_website_data_manager_remove_finish(manager.ptr(), result, &error)) {
+		g_warning("volo: trimming disk cache: %s", error->message);
+		g_error_free(error);
+	}
+}
+
+void cache_monitor::page_loaded(webkit::web_view& wv) {
+	wv.run_javascript_in_world(timing_script, script_world, on_timing_collected, this);
+}
+
+void cache_monitor::on_timing_collected(GObject *wv, GAsyncResult *result) {
+	GError *error = nullptr;
+	auto js = webkit_web_view_run_javascript_in_world_finish(WEBKIT_WEB_VIEW(wv),
+		result, &error);
+	if (!js) {
+		// The page may have been closed or navigated away from.
+		g_error_free(error);
+		return;
+	}
+	auto text = jsc_value_to_string(webkit_javascript_result_get_js_value(js));
+	unsigned long hits, misses, unknown;
+	if (sscanf(text, "%lu %lu %lu", &hits, &misses, &unknown) == 3) {
+		counters.hits += hits;
+		counters.misses += misses;
+		counters.unknown += unknown;
+	}
+	g_free(text);
+	webkit_javascript_result_unref(js);
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_CACHE_H
+#define _VOLO_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include <webkit.h>
+#include <stall_monitor.h>
+
+namespace volo {
+
+// cache_policy describes how resources are cached.  An empty directory
+// stores the disk cache in WebKit's default location.  A nonzero
+// max_disk_size limits the disk cache to that many bytes.
+struct cache_policy {
+	WebKitCacheModel model{WEBKIT_CACHE_MODEL_WEB_BROWSER};
+	std::string directory;
+	uint64_t max_disk_size{0};
+};
+
+// cache_monitor measures the disk cache of a website data manager and keeps
+// it within the policy's size limit.  WebKit manages the cache itself and
+// exposes no size limit, so the cache is measured periodically and, when
+// over the limit, the cached data of the sites using the most space is
+// removed.
+//
+// WebKit also exposes no cache hit counts.  They are estimated from the
+// Resource Timing entries of each loaded page instead: a resource with a
+// body but no bytes transferred was served from the cache.
+class cache_monitor {
+public:
+	struct stats {
+		unsigned long hits{0};
+		unsigned long misses{0};
+		// Resources whose timing is hidden from the page, such as
+		// those from other origins.
+		unsigned long unknown{0};
+		uint64_t disk_usage{0};
+		unsigned int sites{0};
+		unsigned long evictions{0};
+	};
+
+private:
+	webkit::website_data_manager& manager;
+	cache_policy policy;
+	stats counters;
+	bool measuring{false};
+	unsigned int measure_source;
+
+public:
+	cache_monitor(webkit::website_data_manager&, const cache_policy&);
+	~cache_monitor();
+
+	cache_monitor(const cache_monitor&) = delete;
+	cache_monitor& operator=(const cache_monitor&) = delete;
+
+	// measure begins measuring the disk cache, removing data if it
+	// exceeds the size limit.
+	void measure();
+
+	// page_loaded counts the cache hits and misses of the page loaded
+	// by wv.
+	void page_loaded(webkit::web_view& wv);
+
+	// append_stats appends a line of the cache hit counts and hit rate,
+	// and of the disk cache's size and evictions.
+	void append_stats(std::string&) const;
+
+private:
+	bool on_measure_timeout();
+	void on_fetched(GAsyncResult *);
+	void on_removed(GAsyncResult *);
+	void on_timing_collected(GObject *, GAsyncResult *);
+
+	static gboolean on_measure_timeout(cache_monitor *m) {
+		slot_timer t{"cache_monitor::on_measure_timeout"};
+		return m->on_measure_timeout();
+	}
+	static void on_fetched(GObject *, GAsyncResult *result, gpointer m) {
+		slot_timer t{"cache_monitor::on_fetched"};
+		static_cast<cache_monitor *>(m)->on_fetched(result);
+	}
+	static void on_removed(GObject *, GAsyncResult *result, gpointer m) {
+		slot_timer t{"cache_monitor::on_removed"};
+		static_cast<cache_monitor *>(m)->on_removed(result);
+	}
+	static void on_timing_collected(GObject *wv, GAsyncResult *result, gpointer m) {
+		slot_timer t{"cache_monitor::on_timing_collected"};
+		static_cast<cache_monitor *>(m)->on_timing_collected(wv, result);
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_CACHE_H
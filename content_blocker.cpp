@@ -0,0 +1,488 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#include <content_blocker.h>
+#include <encoding.h>
+
+using namespace volo;
+
+// Version of the filter conversion.  It is included in the hash identifying
+// compiled filters, so that changes to the conversion invalidate the cache.
+const uint32_t converter_version = 1;
+
+// Maximum number of rules compiled into each content filter.  WebKit refuses
+// to compile larger rule lists, so longer lists are split between filters.
+const size_t max_rules_per_filter = 50000;
+
+// Regular expression (in the subset understood by WebKit) matching a URI's
+// scheme and any subdomains, which replaces the "||" anchor of a filter.
+static const char domain_anchor[] = "^[^:]+://+([^:/]+\\.)?";
+
+// Character class matching the separator characters, written '^' in
+// filters.
+static const char separator_class[] = "[^a-zA-Z0-9_.%-]";
+
+// Filter options naming resource types, and the WebKit resource types they
+// correspond to.
+static const char * const webkit_resource_types[] = {
+	"document", "image", "style-sheet", "script", "font", "raw", "media", "popup",
+};
+static const struct {
+	const char *option;
+	unsigned int type;
+} resource_type_options[] = {
+	{"subdocument", 0},
+	{"image", 1},
+	{"stylesheet", 2},
+	{"script", 3},
+	{"font", 4},
+	{"xmlhttprequest", 5},
+	{"websocket", 5},
+	{"object", 5},
+	{"ping", 5},
+	{"other", 5},
+	{"media", 6},
+	{"popup", 7},
+};
+const unsigned int all_resource_types = (1 << 8) - 1;
+
+static unsigned int resource_type_mask(const std::string& option) {
+	for (auto& o : resource_type_options) {
+		if (option == o.option) {
+			return 1 << o.type;
+		}
+	}
+	return 0;
+}
+
+static bool is_ascii(const std::string& s) {
+	return std::all_of(s.begin(), s.end(), [](unsigned char c) { return c >= 0x20 && c < 0x7f; });
+}
+
+static std::vector<std::string> split(const std::string& s, char sep) {
+	std::vector<std::string> fields;
+	size_t start = 0, end;
+	while ((end = s.find(sep, start)) != std::string::npos) {
+		fields.push_back(s.substr(start, end - start));
+		start = end + 1;
+	}
+	fields.push_back(s.substr(start));
+	return fields;
+}
+
+// append_domains appends to a trigger the domains (and their subdomains) it
+// is limited to, given a list of domains where those excluded are prefixed
+// by '~'.  WebKit triggers can either include or exclude domains but not
+// both, so when a filter does both only the included domains are kept.
+static bool append_domains(std::string& trigger, const std::vector<std::string>& domains) {
+	std::vector<std::string> include, exclude;
+	for (auto d : domains) {
+		if (d.empty()) {
+			continue;
+		}
+		auto excluded = d[0] == '~';
+		if (excluded) {
+			d.erase(0, 1);
+		}
+		if (d.empty() || !is_ascii(d)) {
+			return false;
+		}
+		std::transform(d.begin(), d.end(), d.begin(), [](unsigned char c) { return tolower(c); });
+		(excluded ? exclude : include).push_back("*" + d);
+	}
+
+	auto& list = include.empty() ? exclude : include;
+	if (list.empty()) {
+		return true;
+	}
+	trigger += include.empty() ? ",\"unless-domain\":[" : ",\"if-domain\":[";
+	for (size_t i = 0; i < list.size(); ++i) {
+		if (i) {
+			trigger += ',';
+		}
+		append_json_string(trigger, list[i]);
+	}
+	trigger += ']';
+	return true;
+}
+
+void filter_converter::add_list(const char *text, size_t len) {
+	auto end = text + len;
+	while (text < end) {
+		auto nl = static_cast<const char *>(memchr(text, '\n', end - text));
+		auto line_end = nl ? nl : end;
+		auto first = text;
+		while (first < line_end && isspace(static_cast<unsigned char>(*first))) {
+			++first;
+		}
+		auto last = line_end;
+		while (last > first && isspace(static_cast<unsigned char>(last[-1]))) {
+			--last;
+		}
+		// Comments begin with '!', and the list header with '['.
+		if (first != last && *first != '!' && *first != '[') {
+			add_filter(std::string{first, last});
+		}
+		if (!nl) {
+			break;
+		}
+		text = nl + 1;
+	}
+}
+
+void filter_converter::add_filter(const std::string& filter) {
+	bool converted;
+	size_t sep;
+	if (filter.find("#@#") != std::string::npos || filter.find("#?#") != std::string::npos ||
+		filter.find("#$#") != std::string::npos || filter.find("#%#") != std::string::npos) {
+
+		// Element hiding exceptions, extended selectors, and
+		// snippets.
+		converted = false;
+	} else if ((sep = filter.find("##")) != std::string::npos) {
+		converted = add_element_hiding(filter, sep);
+	} else {
+		converted = add_blocking(filter);
+	}
+	if (!converted) {
+		++skipped;
+	}
+}
+
+bool filter_converter::add_element_hiding(const std::string& filter, size_t sep) {
+	auto selector = filter.substr(sep + 2);
+	if (selector.empty() || !is_ascii(selector) ||
+		selector.find(":-abp-") != std::string::npos ||
+		selector.find(":has(") != std::string::npos ||
+		selector.find(":xpath(") != std::string::npos) {
+
+		return false;
+	}
+
+	std::string rule = "{\"trigger\":{\"url-filter\":\".*\"";
+	if (sep && !append_domains(rule, split(filter.substr(0, sep), ','))) {
+		return false;
+	}
+	rule += "},\"action\":{\"type\":\"css-display-none\",\"selector\":";
+	append_json_string(rule, selector);
+	rule += "}}";
+	rules.push_back(std::move(rule));
+	return true;
+}
+
+bool filter_converter::add_blocking(const std::string& filter) {
+	auto exception = !filter.compare(0, 2, "@@");
+	auto pattern = filter.substr(exception ? 2 : 0);
+	std::string options;
+	auto dollar = pattern.rfind('$');
+	if (dollar != std::string::npos) {
+		options = pattern.substr(dollar + 1);
+		pattern.erase(dollar);
+	}
+	if (!is_ascii(pattern) ||
+		(pattern.size() >= 2 && pattern.front() == '/' && pattern.back() == '/')) {
+
+		// Regular expression filters use syntax WebKit does not
+		// support.
+		return false;
+	}
+
+	std::string url_filter;
+	size_t i = 0, end = pattern.size();
+	if (!pattern.compare(0, 2, "||")) {
+		url_filter = domain_anchor;
+		i = 2;
+	} else if (!pattern.compare(0, 1, "|")) {
+		url_filter = "^";
+		i = 1;
+	}
+	auto anchored_end = end > i && pattern[end - 1] == '|';
+	if (anchored_end) {
+		--end;
+	}
+	for (; i < end; ++i) {
+		auto c = pattern[i];
+		switch (c) {
+		case '*':
+			url_filter += ".*";
+			continue;
+		case '^':
+			url_filter += separator_class;
+			continue;
+		case '.': case '+': case '?': case '(': case ')': case '[': case ']':
+		case '{': case '}': case '\\': case '|': case '$':
+			url_filter += '\\';
+			break;
+		}
+		url_filter += c;
+	}
+	if (anchored_end) {
+		url_filter += '$';
+	}
+	if (url_filter.empty()) {
+		url_filter = ".*";
+	}
+
+	std::string rule = "{\"trigger\":{\"url-filter\":";
+	append_json_string(rule, url_filter);
+	unsigned int types = 0, excluded_types = 0;
+	const char *load_type = nullptr;
+	for (auto& option : split(options, ',')) {
+		if (option.empty()) {
+			continue;
+		}
+		auto negated = option[0] == '~';
+		auto name = option.substr(negated ? 1 : 0);
+		unsigned int type;
+		if (name == "third-party") {
+			load_type = negated ? "first-party" : "third-party";
+		} else if (name == "match-case") {
+			rule += ",\"url-filter-is-case-sensitive\":true";
+		} else if (!negated && !name.compare(0, 7, "domain=")) {
+			if (!append_domains(rule, split(name.substr(7), '|'))) {
+				return false;
+			}
+		} else if ((type = resource_type_mask(name))) {
+			(negated ? excluded_types : types) |= type;
+		} else if (name != "important" && name != "collapse") {
+			return false;
+		}
+	}
+	if (excluded_types) {
+		types = (types ? types : all_resource_types) & ~excluded_types;
+		if (!types) {
+			return false;
+		}
+	}
+	if (types) {
+		rule += ",\"resource-type\":[";
+		auto first = true;
+		for (unsigned int t = 0; t < 8; ++t) {
+			if (types & (1 << t)) {
+				if (!first) {
+					rule += ',';
+				}
+				first = false;
+				append_json_string(rule, webkit_resource_types[t]);
+			}
+		}
+		rule += ']';
+	}
+	if (load_type) {
+		rule += ",\"load-type\":[";
+		append_json_string(rule, load_type);
+		rule += ']';
+	}
+	rule += exception ? "},\"action\":{\"type\":\"ignore-previous-rules\"}}" :
+		"},\"action\":{\"type\":\"block\"}}";
+	(exception ? exceptions : rules).push_back(std::move(rule));
+	return true;
+}
+
+std::string filter_converter::json(size_t first, size_t count) const {
+	std::string out = "[";
+	auto append = [&out](const std::string& rule) {
+		if (out.size() > 1) {
+			out += ',';
+		}
+		out += rule;
+	};
+	auto last = std::min(first + count, rules.size());
+	for (auto i = first; i < last; ++i) {
+		append(rules[i]);
+	}
+	// Exceptions only apply to preceding rules of the same list.
+	for (auto& rule : exceptions) {
+		append(rule);
+	}
+	out += ']';
+	return out;
+}
+
+content_blocker::content_blocker() :
+	manager{webkit::user_content_manager::create()} {}
+
+content_blocker::~content_blocker() {
+	if (store) {
+		g_object_unref(store);
+	}
+}
+
+void content_blocker::load() {
+	auto dir = g_build_filename(g_get_user_config_dir(), "volo", "filters", nullptr);
+	auto d = g_dir_open(dir, 0, nullptr);
+	if (!d) {
+		g_free(dir);
+		finish();
+		return;
+	}
+	std::vector<std::string> names;
+	while (auto name = g_dir_read_name(d)) {
+		names.emplace_back(name);
+	}
+	g_dir_close(d);
+	std::sort(names.begin(), names.end());
+
+	auto h = fnv1a(&converter_version, sizeof(converter_version));
+	for (auto& name : names) {
+		auto path = g_build_filename(dir, name.c_str(), nullptr);
+		gchar *contents;
+		gsize len;
+		GError *error = nullptr;
+		if (g_file_get_contents(path, &contents, &len, &error)) {
+			h = fnv1a(&len, sizeof(len), h);
+			h = fnv1a(contents, len, h);
+			lists.emplace_back(contents, len);
+			g_free(contents);
+		} else {
+			g_warning("volo: %s", error->message);
+			g_error_free(error);
+		}
+		g_free(path);
+	}
+	g_free(dir);
+	if (lists.empty()) {
+		finish();
+		return;
+	}
+
+	// Compiled filters are identified as volo-<hash>-<count>-<index>.
+	char id[32];
+	snprintf(id, sizeof(id), "volo-%016llx-", static_cast<unsigned long long>(h));
+	prefix = id;
+
+	auto store_path = g_build_filename(g_get_user_cache_dir(), "volo", "content-filters", nullptr);
+	store = webkit_user_content_filter_store_new(store_path);
+	g_free(store_path);
+	webkit_user_content_filter_store_fetch_identifiers(store, nullptr, on_identifiers_fetched, this);
+}
+
+void content_blocker::on_identifiers_fetched(GAsyncResult *result) {
+	auto ids = webkit_user_content_filter_store_fetch_identifiers_finish(store, result);
+
+	// Filters compiled from the current lists are only used if all of
+	// them were saved.  Any others were compiled from lists which have
+	// since changed.
+	std::vector<std::string> cached, stale;
+	size_t count = 0;
+	for (auto id = ids; id && *id; ++id) {
+		if (!g_str_has_prefix(*id, "volo-")) {
+			continue;
+		}
+		size_t n, i;
+		if (g_str_has_prefix(*id, prefix.c_str()) &&
+			sscanf(*id + prefix.size(), "%zu-%zu", &n, &i) == 2 &&
+			(cached.empty() || n == count)) {
+
+			count = n;
+			cached.emplace_back(*id);
+		} else {
+			stale.emplace_back(*id);
+		}
+	}
+	g_strfreev(ids);
+	if (cached.size() != count) {
+		stale.insert(stale.end(), cached.begin(), cached.end());
+		cached.clear();
+	}
+	for (auto& id : stale) {
+		webkit_user_content_filter_store_remove(store, id.c_str(), nullptr, nullptr, nullptr);
+	}
+
+	if (cached.empty()) {
+		compile();
+		return;
+	}
+	loading = cached.size();
+	for (auto& id : cached) {
+		webkit_user_content_filter_store_load(store, id.c_str(), nullptr, on_filter_loaded, this);
+	}
+}
+
+void content_blocker::on_filter_loaded(GAsyncResult *result) {
+	GError *error = nullptr;
+	auto filter = webkit_user_content_filter_store_load_finish(store, result, &error);
+	if (filter) {
+		manager->add_filter(*filter);
+		webkit_user_content_filter_unref(filter);
+	} else {
+		g_warning("volo: loading content filter: %s", error->message);
+		g_error_free(error);
+		load_failed = true;
+	}
+	if (--loading) {
+		return;
+	}
+
+	if (load_failed) {
+		// Recompile every filter, rather than mixing filters from
+		// the cache with new ones.
+		manager->remove_all_filters();
+		compile();
+	} else {
+		std::vector<std::string>{}.swap(lists);
+		finish();
+	}
+}
+
+void content_blocker::compile() {
+	filter_converter converter;
+	for (auto& list : lists) {
+		converter.add_list(list.data(), list.size());
+	}
+	std::vector<std::string>{}.swap(lists);
+	if (converter.skipped_filters()) {
+		g_message("volo: skipped %zu unsupported content filters", converter.skipped_filters());
+	}
+	if (!converter.size()) {
+		finish();
+		return;
+	}
+
+	auto count = std::max<size_t>(1, (converter.size() + max_rules_per_filter - 1) /
+		max_rules_per_filter);
+	saving = count;
+	for (size_t i = 0; i < count; ++i) {
+		auto json = converter.json(i * max_rules_per_filter, max_rules_per_filter);
+		auto id = prefix + std::to_string(count) + "-" + std::to_string(i);
+		auto source = g_bytes_new(json.data(), json.size());
+		webkit_user_content_filter_store_save(store, id.c_str(), source, nullptr,
+			on_filter_saved, this);
+		g_bytes_unref(source);
+	}
+}
+
+void content_blocker::on_filter_saved(GAsyncResult *result) {
+	GError *error = nullptr;
+	auto filter = webkit_user_content_filter_store_save_finish(store, result, &error);
+	if (filter) {
+		manager->add_filter(*filter);
+		webkit_user_content_filter_unref(filter);
+	} else {
+		g_warning("volo: compiling content filter: %s", error->message);
+		g_error_free(error);
+	}
+	if (!--saving) {
+		finish();
+	}
+}
+
+void content_blocker::set_ready(std::function<void()> f) {
+	ready_func = std::move(f);
+	if (ready && ready_func) {
+		ready_func();
+	}
+}
+
+void content_blocker::finish() {
+	ready = true;
+	if (ready_func) {
+		ready_func();
+	}
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_CONTENT_BLOCKER_H
+#define _VOLO_CONTENT_BLOCKER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <gtk.h>
+#include <webkit.h>
+#include <stall_monitor.h>
+
+namespace volo {
+
+// filter_converter converts filter lists in the EasyList (Adblock Plus)
+// format to WebKit content blocker rules.  Blocking and element hiding
+// filters, and blocking exceptions, are converted.  Filters using features
+// WebKit cannot express (regular expressions, element hiding exceptions,
+// extended selectors, and most options other than resource types, party
+// and domains) are skipped.
+class filter_converter {
+private:
+	std::vector<std::string> rules;
+	std::vector<std::string> exceptions;
+	size_t skipped{0};
+
+public:
+	// add_list converts each filter of a list.
+	void add_list(const char *text, size_t len);
+
+	// size returns the number of converted blocking and element hiding
+	// rules, which are split between rule lists by json.
+	size_t size() const { return rules.size(); }
+	size_t skipped_filters() const { return skipped; }
+
+	// json returns a WebKit content blocker rule list (a JSON array)
+	// of count rules beginning at first, followed by all exceptions.
+	std::string json(size_t first, size_t count) const;
+
+private:
+	void add_filter(const std::string& filter);
+	bool add_element_hiding(const std::string& filter, size_t sep);
+	bool add_blocking(const std::string& filter);
+};
+
+// content_blocker blocks ads and trackers in every web_view created with its
+// user content manager.  Filter lists are read from the filters directory of
+// volo's configuration directory, converted, and compiled by WebKit into
+// content filters.  The compiled filters are cached in the user's cache
+// directory, identified by a hash of the lists, so they are only converted
+// and compiled again after the lists change.
+class content_blocker {
+private:
+	using manager_ptr = gtk::unique_ptr<webkit::user_content_manager,
+		gtk::unref_delete<webkit::user_content_manager>>;
+
+	manager_ptr manager;
+	WebKitUserContentFilterStore *store{nullptr};
+	// Identifier prefix of the compiled filters for the current lists.
+	std::string prefix;
+	std::vector<std::string> lists;
+	// Number of filter loads which have not yet completed, and whether
+	// any failed.
+	size_t loading{0};
+	bool load_failed{false};
+	// Number of filters being compiled.
+	size_t saving{0};
+	bool ready{false};
+	std::function<void()> ready_func;
+
+public:
+	content_blocker();
+	~content_blocker();
+
+	content_blocker(const content_blocker&) = delete;
+	content_blocker& operator=(const content_blocker&) = delete;
+
+	// content_manager returns the user content manager to create
+	// web_views with.
+	webkit::user_content_manager& content_manager() { return *manager; }
+
+	// load reads the filter lists and begins loading their compiled
+	// filters, compiling them first if they are not cached.  Filters
+	// are added to the content manager as they become ready.
+	void load();
+
+	// set_ready sets a function called once every filter has been
+	// added, or has failed to load or compile.  It is called at once if
+	// that has already happened.
+	void set_ready(std::function<void()>);
+
+private:
+	void compile();
+	void finish();
+	void on_identifiers_fetched(GAsyncResult *);
+	void on_filter_loaded(GAsyncResult *);
+	void on_filter_saved(GAsyncResult *);
+
+	static void on_identifiers_fetched(GObject *, GAsyncResult *result, gpointer blocker) {
+		slot_timer t{"content_blocker::on_identifiers_fetched"};
+		static_cast<content_blocker *>(blocker)->on_identifiers_fetched(result);
+	}
+	static void on_filter_loaded(GObject *, GAsyncResult *result, gpointer blocker) {
+		slot_timer t{"content_blocker::on_filter_loaded"};
+		static_cast<content_blocker *>(blocker)->on_filter_loaded(result);
+	}
+	static void on_filter_saved(GObject *, GAsyncResult *result, gpointer blocker) {
+		slot_timer t{"content_blocker::on_filter_saved"};
+		static_cast<content_blocker *>(blocker)->on_filter_saved(result);
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_CONTENT_BLOCKER_H
@@ -0,0 +1,100 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_ENCODING_H
+#define _VOLO_ENCODING_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+namespace volo {
+
+// put_u32 appends v to s in host byte order, as the on-disk formats (the
+// history log, session journal and text index) store integers.
+inline void put_u32(std::string& s, uint32_t v) {
+	s.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+// get_u32 reads an integer written by put_u32, which need not be aligned.
+inline uint32_t get_u32(const void *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// write_all writes all n bytes of buf to fd, retrying interrupted and
+// partial writes, and returns false on error.
+inline bool write_all(int fd, const char *buf, size_t n) {
+	while (n > 0) {
+		auto w = write(fd, buf, n);
+		if (w == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		buf += w;
+		n -= w;
+	}
+	return true;
+}
+
+inline bool write_all(int fd, const std::string& s) {
+	return write_all(fd, s.data(), s.size());
+}
+
+// FNV-1a hashes bytes one at a time from fnv1a_basis.  fnv1a_add adds a
+// byte to hash h, for callers transforming bytes as they are hashed.
+const uint64_t fnv1a_basis = 0xcbf29ce484222325;
+
+inline uint64_t fnv1a_add(uint64_t h, unsigned char b) {
+	return (h ^ b) * 0x100000001b3;
+}
+
+// fnv1a returns the hash of n bytes at p, continuing from h.
+inline uint64_t fnv1a(const void *p, size_t n, uint64_t h = fnv1a_basis) {
+	auto b = static_cast<const unsigned char *>(p);
+	while (n--) {
+		h = fnv1a_add(h, *b++);
+	}
+	return h;
+}
+
+// append_json_string appends n bytes of s as a JSON string, escaping quotes,
+// backslashes and control characters.
+inline void append_json_string(std::string& out, const char *s, size_t n) {
+	out += '"';
+	for (auto end = s + n; s != end; ++s) {
+		auto c = static_cast<unsigned char>(*s);
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if (c < 0x20) {
+			char escape[8];
+			snprintf(escape, sizeof(escape), "\\u%04x", c);
+			out += escape;
+		} else {
+			out += c;
+		}
+	}
+	out += '"';
+}
+
+inline void append_json_string(std::string& out, const char *s) {
+	append_json_string(out, s, strlen(s));
+}
+
+inline void append_json_string(std::string& out, const std::string& s) {
+	append_json_string(out, s.data(), s.size());
+}
+
+} // namespace volo
+
+#endif // _VOLO_ENCODING_H
@@ -0,0 +1,230 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include <fuzzy.h>
+
+using namespace volo::fuzzy;
+
+// Score components of each matched character.
+const int match_score = 16;
+const int boundary_bonus = 12;
+const int adjacent_bonus = 8;
+// Skipped characters each cost one point, up to max_gap_penalty per gap.
+const int max_gap_penalty = 8;
+
+static inline char fold(char c) {
+	return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+static inline bool is_separator(char c) {
+	switch (c) {
+	case '/': case '.': case '-': case '_': case ' ':
+	case ':': case '?': case '&': case '=': case '#':
+		return true;
+	}
+	return false;
+}
+
+namespace {
+
+// scorer accumulates the score of successive leftmost matches.  All search
+// implementations feed it the same match positions.
+struct scorer {
+	const char *text;
+	int score{0};
+	size_t next{0};
+
+	explicit scorer(const char *text) : text{text} {}
+
+	void match(size_t j) {
+		score += match_score;
+		if (j == 0 || is_separator(text[j - 1])) {
+			score += boundary_bonus;
+		}
+		if (j == next && j != 0) {
+			score += adjacent_bonus;
+		}
+		score -= std::min<size_t>(j - next, max_gap_penalty);
+		next = j + 1;
+	}
+
+	int result() const { return std::max(score, 0); }
+};
+
+} // namespace
+
+// bag_bit maps letters and digits to distinct bits, and all other bytes to
+// the remaining 28.
+static inline uint64_t bag_bit(char c) {
+	unsigned char u = fold(c);
+	unsigned bit;
+	if (u >= 'a' && u <= 'z') {
+		bit = u - 'a';
+	} else if (u >= '0' && u <= '9') {
+		bit = 26 + u - '0';
+	} else {
+		bit = 36 + u % 28;
+	}
+	return uint64_t(1) << bit;
+}
+
+uint64_t volo::fuzzy::char_bag(const char *s, size_t len) {
+	uint64_t bag = 0;
+	for (size_t i = 0; i < len; ++i) {
+		bag |= bag_bit(s[i]);
+	}
+	return bag;
+}
+
+pattern::pattern(const std::string& s) : chars{s} {
+	std::transform(chars.begin(), chars.end(), chars.begin(), fold);
+	chars.erase(std::remove(chars.begin(), chars.end(), '\0'), chars.end());
+	bag = char_bag(chars.data(), chars.size());
+}
+
+int pattern::max_score() const {
+	return chars.size() * (match_score + boundary_bonus + adjacent_bonus);
+}
+
+int volo::fuzzy::score_scalar(const pattern& p, const char *text, size_t len) {
+	auto& chars = p.folded();
+	if (chars.empty()) {
+		return 0;
+	}
+	scorer s{text};
+	size_t i = 0;
+	for (size_t j = 0; j < len; ++j) {
+		if (fold(text[j]) == chars[i]) {
+			s.match(j);
+			if (++i == chars.size()) {
+				return s.result();
+			}
+		}
+	}
+	return -1;
+}
+
+#if defined(__SSE2__)
+
+// The vector searches fold a block of text at a time, then find successive
+// pattern characters in it by comparing against each in turn.  A final
+// partial block is copied into a zero-padded buffer; the NUL padding can
+// never match since patterns contain no NULs.
+
+int volo::fuzzy::score_sse2(const pattern& p, const char *text, size_t len) {
+	auto& chars = p.folded();
+	scorer s{text};
+	size_t i = 0;
+	const auto before_upper = _mm_set1_epi8('A' - 1);
+	const auto after_upper = _mm_set1_epi8('Z' + 1);
+	const auto case_bit = _mm_set1_epi8(0x20);
+	char tail[16];
+
+	for (size_t b = 0; b < len; b += 16) {
+		auto block = text + b;
+		if (len - b < 16) {
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, block, len - b);
+			block = tail;
+		}
+		auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+		auto upper = _mm_and_si128(_mm_cmpgt_epi8(x, before_upper),
+			_mm_cmplt_epi8(x, after_upper));
+		x = _mm_or_si128(x, _mm_and_si128(upper, case_bit));
+
+		uint32_t from = 0;
+		for (;;) {
+			uint32_t m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8(chars[i])));
+			m &= ~uint32_t(0) << from;
+			if (!m) {
+				break;
+			}
+			auto j = __builtin_ctz(m);
+			s.match(b + j);
+			if (++i == chars.size()) {
+				return s.result();
+			}
+			if (j == 15) {
+				break;
+			}
+			from = j + 1;
+		}
+	}
+	return -1;
+}
+
+__attribute__((target("avx2")))
+int volo::fuzzy::score_avx2(const pattern& p, const char *text, size_t len) {
+	auto& chars = p.folded();
+	scorer s{text};
+	size_t i = 0;
+	const auto before_upper = _mm256_set1_epi8('A' - 1);
+	const auto after_upper = _mm256_set1_epi8('Z' + 1);
+	const auto case_bit = _mm256_set1_epi8(0x20);
+	char tail[32];
+
+	for (size_t b = 0; b < len; b += 32) {
+		auto block = text + b;
+		if (len - b < 32) {
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, block, len - b);
+			block = tail;
+		}
+		auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+		auto upper = _mm256_and_si256(_mm256_cmpgt_epi8(x, before_upper),
+			_mm256_cmpgt_epi8(after_upper, x));
+		x = _mm256_or_si256(x, _mm256_and_si256(upper, case_bit));
+
+		uint32_t from = 0;
+		for (;;) {
+			uint32_t m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(chars[i])));
+			m &= ~uint32_t(0) << from;
+			if (!m) {
+				break;
+			}
+			auto j = __builtin_ctz(m);
+			s.match(b + j);
+			if (++i == chars.size()) {
+				return s.result();
+			}
+			if (j == 31) {
+				break;
+			}
+			from = j + 1;
+		}
+	}
+	return -1;
+}
+
+#endif // __SSE2__
+
+using score_func = int (*)(const pattern&, const char *, size_t);
+
+static score_func select_score() {
+#if defined(__SSE2__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return score_avx2;
+	}
+	return score_sse2;
+#else
+	return score_scalar;
+#endif
+}
+
+static const score_func score_impl = select_score();
+
+int volo::fuzzy::score(const pattern& p, const char *text, size_t len) {
+	if (p.folded().empty()) {
+		return 0;
+	}
+	return score_impl(p, text, len);
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_FUZZY_H
+#define _VOLO_FUZZY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace volo {
+namespace fuzzy {
+
+// char_bag returns a set of the (ASCII case-folded) bytes of s, hashed into
+// 64 bits.  A pattern can only match text whose bag includes the pattern's.
+uint64_t char_bag(const char *s, size_t len);
+
+// pattern is a case-folded fuzzy search pattern.  Characters of the pattern
+// match the same characters of the text, in order, but not necessarily
+// adjacent ones.
+class pattern {
+private:
+	std::string chars;
+	uint64_t bag;
+
+public:
+	explicit pattern(const std::string&);
+
+	const std::string& folded() const { return chars; }
+
+	// may_match returns whether the pattern could match text with the
+	// character bag text_bag.
+	bool may_match(uint64_t text_bag) const { return !(bag & ~text_bag); }
+
+	// max_score is the greatest score any text can have for the pattern.
+	int max_score() const;
+};
+
+// score returns a nonnegative score for the leftmost match of p in text, or
+// -1 if text does not contain the characters of p in order.  Matches at the
+// start of words and runs of adjacent characters score higher; skipped
+// characters score lower.  The text is searched with the widest vector
+// instructions the CPU supports.
+int score(const pattern& p, const char *text, size_t len);
+
+// score_scalar computes the same score as score one byte at a time.
+int score_scalar(const pattern& p, const char *text, size_t len);
+
+#if defined(__SSE2__)
+// score_sse2 and score_avx2 compute the same score as score 16 and 32 bytes
+// at a time.  score_avx2 may only be called if the CPU supports AVX2.
+int score_sse2(const pattern& p, const char *text, size_t len);
+int score_avx2(const pattern& p, const char *text, size_t len);
+#endif
+
+} // namespace fuzzy
+} // namespace volo
+
+#endif // _VOLO_FUZZY_H
@@ -0,0 +1,86 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+// fuzzy_bench times each fuzzy scorer over a set of URI-like texts the size
+// of a large history, reporting the time to score every text once.
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fuzzy.h>
+
+using namespace volo;
+
+static const size_t text_count = 100000;
+static const int rounds = 10;
+
+static std::vector<std::string> uri_texts(std::mt19937& rng) {
+	static const char *const hosts[] = {
+		"example.com", "news.example.org", "docs.example.net",
+		"www.example.co.uk", "git.example.io", "mail.example.com",
+	};
+	static const char word_chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+	std::uniform_int_distribution<size_t> host_dist{0, 5};
+	std::uniform_int_distribution<size_t> char_dist{0, sizeof(word_chars) - 2};
+	std::uniform_int_distribution<int> words_dist{1, 6};
+	std::uniform_int_distribution<int> word_len_dist{3, 12};
+
+	std::vector<std::string> texts;
+	texts.reserve(text_count);
+	for (size_t n = 0; n < text_count; ++n) {
+		std::string s = hosts[host_dist(rng)];
+		for (auto words = words_dist(rng); words--; ) {
+			s += '/';
+			for (auto len = word_len_dist(rng); len--; ) {
+				s += word_chars[char_dist(rng)];
+			}
+		}
+		texts.push_back(std::move(s));
+	}
+	return texts;
+}
+
+using score_func = int (*)(const fuzzy::pattern&, const char *, size_t);
+
+static void bench(const char *name, score_func f, const fuzzy::pattern& p,
+	const std::vector<std::string>& texts) {
+
+	long matches = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; ++r) {
+		for (auto& t : texts) {
+			matches += f(p, t.data(), t.size()) >= 0;
+		}
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+	printf("%-14s %-8s %8.0f us per %zu texts (%ld matches)\n", name,
+		p.folded().c_str(), double(us) / rounds, texts.size(), matches / rounds);
+}
+
+int main() {
+	std::mt19937 rng{1};
+	auto texts = uri_texts(rng);
+#if defined(__SSE2__)
+	__builtin_cpu_init();
+	const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+	// A pattern which usually matches early, one which matches late,
+	// and one which rarely matches, so the whole text is searched.
+	for (auto q : {"exa", "docsxyz", "qqzz"}) {
+		auto p = fuzzy::pattern{q};
+		bench("score_scalar", fuzzy::score_scalar, p, texts);
+#if defined(__SSE2__)
+		bench("score_sse2", fuzzy::score_sse2, p, texts);
+		if (avx2) {
+			bench("score_avx2", fuzzy::score_avx2, p, texts);
+		}
+#endif
+	}
+	return 0;
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+// fuzzy_test checks that the vector fuzzy scorers agree with score_scalar
+// over random patterns and texts.
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include <fuzzy.h>
+
+using namespace volo;
+
+// Texts are drawn from a small alphabet, so that patterns often match, with
+// separators, both cases, and bytes above 0x7f (which are negative as
+// signed chars, as the vector comparisons treat them).
+static const char alphabet[] = "abcdeABCDE/.-_ :?&=#\x80\xc3\xff";
+
+static std::string random_text(std::mt19937& rng, size_t max_len) {
+	std::uniform_int_distribution<size_t> len_dist{0, max_len};
+	std::uniform_int_distribution<size_t> char_dist{0, sizeof(alphabet) - 2};
+	std::string s(len_dist(rng), '\0');
+	for (auto& c : s) {
+		c = alphabet[char_dist(rng)];
+	}
+	return s;
+}
+
+int main() {
+	std::mt19937 rng{1};
+#if defined(__SSE2__)
+	__builtin_cpu_init();
+	const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+	unsigned int failures = 0;
+	const unsigned int iterations = 200000;
+
+	for (unsigned int n = 0; n < iterations; ++n) {
+		auto p = fuzzy::pattern{random_text(rng, 6)};
+		// Lengths around and beyond the vector widths exercise the
+		// partial final blocks.
+		auto text = random_text(rng, n % 2 ? 40 : 300);
+		auto want = fuzzy::score_scalar(p, text.data(), text.size());
+
+		auto check = [&](const char *name, int got) {
+			if (got != want && failures++ < 10) {
+				fprintf(stderr, "%s: pattern \"%s\" text \"%s\": got %d, want %d\n",
+					name, p.folded().c_str(), text.c_str(), got, want);
+			}
+		};
+		check("score", fuzzy::score(p, text.data(), text.size()));
+#if defined(__SSE2__)
+		check("score_sse2", p.folded().empty() ? 0 :
+			fuzzy::score_sse2(p, text.data(), text.size()));
+		if (avx2) {
+			check("score_avx2", p.folded().empty() ? 0 :
+				fuzzy::score_avx2(p, text.data(), text.size()));
+		}
+#endif
+	}
+
+	if (failures) {
+		fprintf(stderr, "fuzzy_test: %u mismatches in %u iterations\n",
+			failures, iterations);
+		return 1;
+	}
+	printf("fuzzy_test: %u iterations ok\n", iterations);
+	return 0;
+}
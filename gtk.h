@@ -13,10 +13,24 @@
 
 namespace gtk {
 
+// destroy_delete destroys a widget and releases the reference taken by
+// make_sunk, allowing the object to be finalized once any containers
+// have dropped their references as well.
 template <class T>
 struct destroy_delete {
 	void operator()(T *ptr) const {
 		ptr->destroy();
+		ptr->unref();
+	}
+};
+
+// unref_delete releases the reference to an object which is not a widget,
+// and so has no floating reference or destroy method.  Such objects are
+// owned from their creation and must not be passed to make_sunk.
+template <class T>
+struct unref_delete {
+	void operator()(T *ptr) const {
+		ptr->unref();
 	}
 };
 
@@ -39,6 +53,27 @@ struct connection {
 	}
 };
 
+// Main loop sources.  Slots return whether the source should remain
+// installed (G_SOURCE_CONTINUE) or be removed (G_SOURCE_REMOVE).
+
+template <class U>
+using source_slot = gboolean (*)(U *);
+
+template <class U>
+unsigned int timeout_add(unsigned int interval, U& obj, source_slot<U> slot) {
+	return g_timeout_add(interval, reinterpret_cast<GSourceFunc>(slot), &obj);
+}
+
+template <class U>
+unsigned int timeout_add_seconds(unsigned int interval, U& obj, source_slot<U> slot) {
+	return g_timeout_add_seconds(interval, reinterpret_cast<GSourceFunc>(slot), &obj);
+}
+
+template <class U>
+unsigned int idle_add(int priority, U& obj, source_slot<U> slot) {
+	return g_idle_add_full(priority, reinterpret_cast<GSourceFunc>(slot), &obj, nullptr);
+}
+
 struct style_context;
 struct widget;
 
@@ -96,6 +131,10 @@ struct style_context : gobject<T, Derived> {
 		gtk_style_context_add_class(ptr(), class_name);
 	}
 
+	void remove_class(const char *class_name) {
+		gtk_style_context_remove_class(ptr(), class_name);
+	}
+
 	c_type * ptr() const {
 		return const_cast<c_type *>(reinterpret_cast<const c_type *>(this));
 	}
@@ -114,6 +153,26 @@ struct widget : gobject<T, Derived> {
 		gtk_widget_show_all(ptr());
 	}
 
+	void hide() {
+		gtk_widget_hide(ptr());
+	}
+
+	bool get_visible() const {
+		return gtk_widget_get_visible(ptr());
+	}
+
+	void set_no_show_all(bool no_show_all) {
+		gtk_widget_set_no_show_all(ptr(), no_show_all);
+	}
+
+	void queue_draw() {
+		gtk_widget_queue_draw(ptr());
+	}
+
+	void add_events(int events) {
+		gtk_widget_add_events(ptr(), events);
+	}
+
 	void set_can_focus(bool can_focus) {
 		gtk_widget_set_can_focus(ptr(), can_focus);
 	}
@@ -142,6 +201,10 @@ struct widget : gobject<T, Derived> {
 		gtk_widget_set_sensitive(ptr(), sensitive);
 	}
 
+	void set_tooltip_text(const char *text) {
+		gtk_widget_set_tooltip_text(ptr(), text);
+	}
+
 	void grab_focus() {
 		gtk_widget_grab_focus(ptr());
 	}
@@ -176,6 +239,27 @@ struct widget : gobject<T, Derived> {
 		return this->connect("destroy", G_CALLBACK(slot), &obj);
 	}
 
+	template <class U>
+	using draw_slot = gboolean (*)(Derived *, cairo_t *, U *);
+	template <class U>
+	connection connect_draw(U& obj, draw_slot<U> slot) {
+		return this->connect("draw", G_CALLBACK(slot), &obj);
+	}
+
+	template <class U>
+	using button_press_event_slot = gboolean (*)(Derived *, GdkEventButton *, U *);
+	template <class U>
+	connection connect_button_press_event(U& obj, button_press_event_slot<U> slot) {
+		return this->connect("button-press-event", G_CALLBACK(slot), &obj);
+	}
+
+	template <class U>
+	using size_allocate_slot = void (*)(Derived *, GdkRectangle *, U *);
+	template <class U>
+	connection connect_size_allocate(U& obj, size_allocate_slot<U> slot) {
+		return this->connect("size-allocate", G_CALLBACK(slot), &obj);
+	}
+
 	// Class vfuncs.
 
 	int key_press_event(GdkEventKey& event) {
@@ -234,6 +318,10 @@ struct window : bin<T, Derived> {
 		gtk_window_set_default_size(ptr(), width, height);
 	}
 
+	void present() {
+		gtk_window_present(ptr());
+	}
+
 	template <class U, class UDerived>
 	void set_titlebar(widget<U, UDerived>& titlebar) {
 		gtk_window_set_titlebar(ptr(), titlebar.ptr());
@@ -256,6 +344,15 @@ struct editable : gobject<T, Derived> {
 		gtk_editable_select_region(ptr(), start_pos, end_pos);
 	}
 
+	// Signals.
+
+	template <class U>
+	using changed_slot = void (*)(Derived *, U *);
+	template <class U>
+	connection connect_changed(U& obj, changed_slot<U> slot) {
+		return this->connect("changed", G_CALLBACK(slot), &obj);
+	}
+
 	c_type * ptr() const {
 		return const_cast<c_type *>(reinterpret_cast<const c_type *>(this));
 	}
@@ -337,6 +434,10 @@ struct label : misc<T, Derived> {
 		gtk_label_set_ellipsize(ptr(), mode);
 	}
 
+	const char * get_text() const {
+		return gtk_label_get_text(ptr());
+	}
+
 	c_type * ptr() const {
 		return const_cast<c_type *>(reinterpret_cast<const c_type *>(this));
 	}
@@ -420,10 +521,19 @@ struct notebook : container<T, Derived> {
 		return gtk_notebook_get_n_pages(ptr());
 	}
 
+	gtk::widget * get_nth_page(int page_num) const {
+		return reinterpret_cast<gtk::widget *>(gtk_notebook_get_nth_page(ptr(), page_num));
+	}
+
 	void set_current_page(int page_num) {
 		gtk_notebook_set_current_page(ptr(), page_num);
 	}
 
+	template <class U, class UDerived>
+	int page_num(widget<U, UDerived>& child) const {
+		return gtk_notebook_page_num(ptr(), child.ptr());
+	}
+
 	void set_show_tabs(bool show_tabs) {
 		gtk_notebook_set_show_tabs(ptr(), show_tabs);
 	}
@@ -503,6 +613,29 @@ struct header_bar : container<T, Derived> {
 template <class T, class Derived>
 struct popover : bin<T, Derived> {};
 
+template <class T, class Derived>
+struct scrolled_window : bin<T, Derived> {
+	using c_type = GtkScrolledWindow;
+
+	void set_policy(GtkPolicyType hscrollbar_policy, GtkPolicyType vscrollbar_policy) {
+		gtk_scrolled_window_set_policy(ptr(), hscrollbar_policy, vscrollbar_policy);
+	}
+
+	// scroll_to_show scrolls vertically, as little as possible, so that
+	// the rows from top to bottom are shown.
+	void scroll_to_show(double top, double bottom) {
+		gtk_adjustment_clamp_page(gtk_scrolled_window_get_vadjustment(ptr()),
+			top, bottom);
+	}
+
+	c_type * ptr() const {
+		return const_cast<c_type *>(reinterpret_cast<const c_type *>(this));
+	}
+};
+
+template <class T, class Derived>
+struct drawing_area : widget<T, Derived> {};
+
 template <class T, class Derived>
 struct search_bar : bin<T, Derived> {
 	using c_type = GtkSearchBar;
@@ -516,6 +649,10 @@ struct search_bar : bin<T, Derived> {
 		gtk_search_bar_set_search_mode(ptr(), search_mode);
 	}
 
+	bool get_search_mode() const {
+		return gtk_search_bar_get_search_mode(ptr());
+	}
+
 	void set_show_close_button(bool visible) {
 		gtk_search_bar_set_show_close_button(ptr(), visible);
 	}
@@ -629,6 +766,18 @@ struct search_bar : methods::search_bar<GtkSearchBar, search_bar> {
 	}
 };
 
+struct scrolled_window : methods::scrolled_window<GtkScrolledWindow, scrolled_window> {
+	static auto create() {
+		return reinterpret_cast<scrolled_window *>(gtk_scrolled_window_new(nullptr, nullptr));
+	}
+};
+
+struct drawing_area : methods::drawing_area<GtkDrawingArea, drawing_area> {
+	static auto create() {
+		return reinterpret_cast<drawing_area *>(gtk_drawing_area_new());
+	}
+};
+
 } // namespace gtk
 
 #endif // _GTK_H
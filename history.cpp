@@ -0,0 +1,645 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <encoding.h>
+#include <fuzzy.h>
+#include <gtk.h>
+#include <history.h>
+
+using namespace volo;
+
+// The weight of a visit halves every history_half_life seconds.
+const double history_half_life = 30 * 24 * 60 * 60;
+const double decay_rate = M_LN2 / history_half_life;
+
+// Entries whose normalized URI begins with the query are ranked as if they
+// had four times as many recent visits.
+const double prefix_bonus = 2 * M_LN2;
+
+// The history log begins with a magic string and version.  Each record that
+// follows is a u32 payload length and a payload of
+//
+//	u8  record type ('v' for a visit, 't' for a title change)
+//	i64 time, in seconds since the epoch
+//	u32 URI length
+//	    URI
+//	    title, filling the rest of the payload
+//
+// in host byte order.
+static const char log_magic[8] = {'v', 'o', 'l', 'o', 'h', 'i', 's', 't'};
+const uint32_t log_version = 1;
+const size_t log_header_size = sizeof(log_magic) + 4;
+const size_t payload_fixed_size = 1 + 8 + 4;
+
+// Queries whose candidates (the URIs with the prefix, or the shortest
+// posting list) number more than dense_query_threshold are first answered
+// by a rank-ordered scan of at most rank_scan_budget entries.
+const size_t dense_query_threshold = 4096;
+const size_t rank_scan_budget = 32768;
+
+// Fuzzy matches are ranked as if each point of fuzzy score were worth
+// 1/16th of a doubling of recent visits (one fully matched character).  At
+// most fuzzy_scan_budget of the highest ranked entries (and those not yet
+// sorted by rank) are scored, as the scan runs on the main thread on every
+// keystroke and must stay well under a millisecond.
+const double fuzzy_weight = M_LN2 / 16;
+const size_t fuzzy_scan_budget = 4096;
+
+// Number of entries added or visited since the last sort of the prefix and
+// rank arrays after which they are merged in.
+const size_t max_unsorted = 4096;
+
+using scored = std::pair<double, uint32_t>;
+
+// normalized_offset returns the offset of uri without its scheme and any
+// leading "www.".
+static uint32_t normalized_offset(const char *uri) {
+	auto p = uri;
+	auto sep = strstr(p, "://");
+	if (sep) {
+		p = sep + 3;
+	}
+	if (!strncmp(p, "www.", 4)) {
+		p += 4;
+	}
+	return p - uri;
+}
+
+static uint32_t trigram(const char *p) {
+	return uint32_t(tolower(static_cast<unsigned char>(p[0]))) << 16 |
+		uint32_t(tolower(static_cast<unsigned char>(p[1]))) << 8 |
+		uint32_t(tolower(static_cast<unsigned char>(p[2])));
+}
+
+static double log_add(double a, double b) {
+	auto hi = std::max(a, b);
+	auto lo = std::min(a, b);
+	return hi + std::log1p(std::exp(lo - hi));
+}
+
+// match returns whether e matches the lowercased query q, setting its score.
+// Substrings are only matched by queries of at least three characters.
+static bool match(const history_entry& e, const std::string& q, double& score) {
+	auto uri = e.normalized_uri();
+	if (!strncasecmp(uri, q.c_str(), q.size())) {
+		score = e.rank + prefix_bonus;
+		return true;
+	}
+	if (q.size() >= 3 && (strcasestr(uri, q.c_str()) || strcasestr(e.title.c_str(), q.c_str()))) {
+		score = e.rank;
+		return true;
+	}
+	return false;
+}
+
+// add_result adds an entry to a min-heap of the limit best scoring entries.
+static void add_result(std::vector<scored>& best, size_t limit, uint32_t id, double score) {
+	auto greater = [](const scored& a, const scored& b) { return a.first > b.first; };
+	if (best.size() == limit && score <= best.front().first) {
+		return;
+	}
+	best.emplace_back(score, id);
+	std::push_heap(best.begin(), best.end(), greater);
+	if (best.size() > limit) {
+		std::pop_heap(best.begin(), best.end(), greater);
+		best.pop_back();
+	}
+}
+
+// gallop returns the first position in the sorted range [first, last) not
+// less than id, searching exponentially outward from first.
+static std::vector<uint32_t>::const_iterator gallop(std::vector<uint32_t>::const_iterator first,
+	std::vector<uint32_t>::const_iterator last, uint32_t id) {
+
+	size_t n = last - first, lo = 0, step = 1;
+	while (step < n && first[step] < id) {
+		lo = step;
+		step *= 2;
+	}
+	return std::lower_bound(first + lo, first + std::min(step + 1, n), id);
+}
+
+uint32_t history_index::find(const char *uri, size_t len) const {
+	if (uri_table.empty()) {
+		return UINT32_MAX;
+	}
+	auto mask = uri_table.size() - 1;
+	for (auto i = fnv1a(uri, len) & mask; uri_table[i]; i = (i + 1) & mask) {
+		auto& e = entries[uri_table[i] - 1];
+		if (e.uri.size() == len && !memcmp(e.uri.data(), uri, len)) {
+			return uri_table[i] - 1;
+		}
+	}
+	return UINT32_MAX;
+}
+
+void history_index::insert_uri(uint32_t id) {
+	// Keep the table at most half full.
+	if (entries.size() * 2 > uri_table.size()) {
+		auto old = std::vector<uint32_t>(std::max<size_t>(uri_table.size() * 2, 1024));
+		old.swap(uri_table);
+		for (auto slot : old) {
+			if (slot && slot - 1 != id) {
+				insert_uri(slot - 1);
+			}
+		}
+	}
+
+	auto& uri = entries[id].uri;
+	auto mask = uri_table.size() - 1;
+	auto i = fnv1a(uri.data(), uri.size()) & mask;
+	while (uri_table[i]) {
+		i = (i + 1) & mask;
+	}
+	uri_table[i] = id + 1;
+}
+
+void history_index::index_trigrams(uint32_t id, const char *text) {
+	auto len = strlen(text);
+	for (size_t i = 0; i + 3 <= len; ++i) {
+		auto& postings = trigrams[trigram(text + i)];
+		if (postings.empty() || postings.back() < id) {
+			postings.push_back(id);
+		} else if (postings.back() != id) {
+			// Only titles of older entries are indexed out of order.
+			auto it = std::lower_bound(postings.begin(), postings.end(), id);
+			if (*it != id) {
+				postings.insert(it, id);
+			}
+		}
+	}
+}
+
+uint32_t history_index::add_visit(const char *uri, int64_t time) {
+	auto id = find(uri, strlen(uri));
+	if (id == UINT32_MAX) {
+		id = entries.size();
+		entries.emplace_back();
+		auto& e = entries.back();
+		e.uri = uri;
+		e.rank = decay_rate * time;
+		e.normalized = normalized_offset(uri);
+		e.chars = fuzzy::char_bag(e.normalized_uri(), e.uri.size() - e.normalized);
+		insert_uri(id);
+		index_trigrams(id, e.normalized_uri());
+		unsorted.push_back(id);
+		is_rank_dirty.push_back(false);
+		if (unsorted.size() > max_unsorted) {
+			sort_prefixes();
+		}
+	} else {
+		auto& e = entries[id];
+		e.rank = log_add(e.rank, decay_rate * time);
+	}
+
+	auto& e = entries[id];
+	++e.visits;
+	e.last_visit = std::max(e.last_visit, time);
+
+	if (!is_rank_dirty[id]) {
+		is_rank_dirty[id] = true;
+		rank_dirty.push_back(id);
+		if (rank_dirty.size() > max_unsorted) {
+			sort_ranks();
+		}
+	}
+	return id;
+}
+
+void history_index::set_title(const char *uri, const char *title) {
+	auto id = find(uri, strlen(uri));
+	if (id == UINT32_MAX || entries[id].title == title) {
+		return;
+	}
+	// Trigrams of a previous title are left in the index.  Queries
+	// verify each candidate, so they only cost a little extra work.
+	auto& e = entries[id];
+	e.title = title;
+	e.chars |= fuzzy::char_bag(e.title.data(), e.title.size());
+	index_trigrams(id, title);
+}
+
+void history_index::sort_prefixes() {
+	if (unsorted.empty()) {
+		return;
+	}
+	auto less = [this](uint32_t a, uint32_t b) {
+		return strcasecmp(entries[a].normalized_uri(), entries[b].normalized_uri()) < 0;
+	};
+	std::sort(unsorted.begin(), unsorted.end(), less);
+	auto mid = by_prefix.size();
+	by_prefix.insert(by_prefix.end(), unsorted.begin(), unsorted.end());
+	std::inplace_merge(by_prefix.begin(), by_prefix.begin() + mid, by_prefix.end(), less);
+	unsorted.clear();
+}
+
+void history_index::sort_ranks() {
+	if (rank_dirty.empty()) {
+		return;
+	}
+	auto greater = [this](uint32_t a, uint32_t b) {
+		return entries[a].rank > entries[b].rank;
+	};
+	by_rank.erase(std::remove_if(by_rank.begin(), by_rank.end(),
+		[this](uint32_t id) { return is_rank_dirty[id]; }), by_rank.end());
+	std::sort(rank_dirty.begin(), rank_dirty.end(), greater);
+	auto mid = by_rank.size();
+	by_rank.insert(by_rank.end(), rank_dirty.begin(), rank_dirty.end());
+	std::inplace_merge(by_rank.begin(), by_rank.begin() + mid, by_rank.end(), greater);
+	for (auto id : rank_dirty) {
+		is_rank_dirty[id] = false;
+	}
+	rank_dirty.clear();
+}
+
+// scan_by_rank finds the best matches for q by examining entries in order of
+// decreasing rank.  It returns false if more than budget entries would need
+// to be examined.
+bool history_index::scan_by_rank(const std::string& q, size_t limit, size_t budget,
+	std::vector<scored>& best) {
+
+	double score;
+	for (auto id : rank_dirty) {
+		if (match(entries[id], q, score)) {
+			add_result(best, limit, id, score);
+		}
+	}
+	for (auto id : by_rank) {
+		if (is_rank_dirty[id]) {
+			continue;
+		}
+		auto& e = entries[id];
+		if (best.size() == limit && e.rank + prefix_bonus <= best.front().first) {
+			return true;
+		}
+		if (!budget--) {
+			return false;
+		}
+		if (match(e, q, score)) {
+			add_result(best, limit, id, score);
+		}
+	}
+	return true;
+}
+
+// scan_fuzzy adds to best the entries, other than those in exclude, which
+// best fuzzy match q, scanning entries in order of decreasing rank.
+void history_index::scan_fuzzy(const std::string& q, size_t limit,
+	const std::vector<scored>& exclude, std::vector<scored>& best) {
+
+	fuzzy::pattern p{q};
+	auto max_bonus = fuzzy_weight * p.max_score();
+	auto consider = [&](uint32_t id) {
+		auto& e = entries[id];
+		if (!p.may_match(e.chars)) {
+			return;
+		}
+		for (auto& s : exclude) {
+			if (s.second == id) {
+				return;
+			}
+		}
+		auto score = std::max(
+			fuzzy::score(p, e.normalized_uri(), e.uri.size() - e.normalized),
+			fuzzy::score(p, e.title.data(), e.title.size()));
+		if (score >= 0) {
+			add_result(best, limit, id, e.rank + fuzzy_weight * score);
+		}
+	};
+
+	auto budget = fuzzy_scan_budget;
+	for (auto id : rank_dirty) {
+		if (!budget--) {
+			return;
+		}
+		consider(id);
+	}
+	for (auto id : by_rank) {
+		if (is_rank_dirty[id]) {
+			continue;
+		}
+		if (best.size() == limit && entries[id].rank + max_bonus <= best.front().first) {
+			return;
+		}
+		if (!budget--) {
+			return;
+		}
+		consider(id);
+	}
+}
+
+void history_index::query(const std::string& text, size_t limit,
+	std::vector<const history_entry *>& results) {
+
+	auto q = text.substr(normalized_offset(text.c_str()));
+	std::transform(q.begin(), q.end(), q.begin(), [](unsigned char c) { return tolower(c); });
+	if (q.empty() || !limit) {
+		return;
+	}
+
+	// The best matches are kept in a min-heap (by score) of at most
+	// limit entries.
+	std::vector<scored> best;
+	best.reserve(limit + 1);
+	double score;
+
+	if (q.size() < 3) {
+		// Too short for the trigram index; only prefix matches.
+		auto lower = std::lower_bound(by_prefix.cbegin(), by_prefix.cend(), q,
+			[this](uint32_t id, const std::string& q) {
+				return strcasecmp(entries[id].normalized_uri(), q.c_str()) < 0;
+			});
+		auto upper = std::upper_bound(lower, by_prefix.cend(), q,
+			[this](const std::string& q, uint32_t id) {
+				return strncasecmp(q.c_str(), entries[id].normalized_uri(), q.size()) < 0;
+			});
+		if (size_t(upper - lower) <= dense_query_threshold ||
+			!scan_by_rank(q, limit, rank_scan_budget, best)) {
+
+			best.clear();
+			for (auto it = lower; it != upper; ++it) {
+				add_result(best, limit, *it, entries[*it].rank + prefix_bonus);
+			}
+			for (auto id : unsorted) {
+				if (match(entries[id], q, score)) {
+					add_result(best, limit, id, score);
+				}
+			}
+		}
+	} else {
+		std::vector<const std::vector<uint32_t> *> lists;
+		for (size_t i = 0; i + 3 <= q.size(); ++i) {
+			auto it = trigrams.find(trigram(q.c_str() + i));
+			if (it == trigrams.end()) {
+				// No entry contains q.
+				lists.clear();
+				break;
+			}
+			lists.push_back(&it->second);
+		}
+		std::sort(lists.begin(), lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+		lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+		if (lists.empty()) {
+			// Nothing to intersect.
+		} else if (lists.front()->size() <= dense_query_threshold ||
+			!scan_by_rank(q, limit, rank_scan_budget, best)) {
+
+			// Intersect the posting lists, starting from the
+			// shortest.  Cursors into the longer lists only move
+			// forward, as candidates are visited in increasing
+			// order.
+			best.clear();
+			std::vector<std::vector<uint32_t>::const_iterator> cursors;
+			for (auto list : lists) {
+				cursors.push_back(list->cbegin());
+			}
+			for (auto id : *lists.front()) {
+				auto all = true;
+				for (size_t i = 1; i < lists.size() && all; ++i) {
+					cursors[i] = gallop(cursors[i], lists[i]->cend(), id);
+					all = cursors[i] != lists[i]->cend() && *cursors[i] == id;
+				}
+				if (all && match(entries[id], q, score)) {
+					add_result(best, limit, id, score);
+				}
+			}
+		}
+	}
+
+	auto greater = [](const scored& a, const scored& b) { return a.first > b.first; };
+	std::sort_heap(best.begin(), best.end(), greater);
+	for (auto& s : best) {
+		results.push_back(&entries[s.second]);
+	}
+
+	if (best.size() < limit) {
+		std::vector<scored> fuzzy;
+		scan_fuzzy(q, limit - best.size(), best, fuzzy);
+		std::sort_heap(fuzzy.begin(), fuzzy.end(), greater);
+		for (auto& s : fuzzy) {
+			results.push_back(&entries[s.second]);
+		}
+	}
+}
+
+history::~history() {
+	if (thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock{mu};
+			stopping = true;
+		}
+		cv.notify_one();
+		thread.join();
+	}
+}
+
+void history::open() {
+	auto dir = g_build_filename(g_get_user_data_dir(), "volo", nullptr);
+	g_mkdir_with_parents(dir, 0700);
+	auto p = g_build_filename(dir, "history", nullptr);
+	path = p;
+	g_free(p);
+	g_free(dir);
+
+	thread = std::thread{&history::run, this};
+}
+
+void history::record_visit(const char *uri) {
+	if (!*uri || !strncmp(uri, "about:", 6)) {
+		return;
+	}
+	auto now = g_get_real_time() / G_USEC_PER_SEC;
+	index.add_visit(uri, now);
+	if (!loaded) {
+		pending.push_back(pending_op{uri, "", now});
+	}
+	append('v', now, uri, "");
+}
+
+void history::set_title(const char *uri, const char *title) {
+	if (!*uri || !*title) {
+		return;
+	}
+	index.set_title(uri, title);
+	if (!loaded) {
+		pending.push_back(pending_op{uri, title, 0});
+	}
+	append('t', 0, uri, title);
+}
+
+void history::append(char type, int64_t time, const char *uri, const char *title) {
+	auto uri_len = strlen(uri);
+	auto title_len = strlen(title);
+	{
+		std::lock_guard<std::mutex> lock{mu};
+		put_u32(write_queue, payload_fixed_size + uri_len + title_len);
+		write_queue.push_back(type);
+		write_queue.append(reinterpret_cast<const char *>(&time), sizeof(time));
+		put_u32(write_queue, uri_len);
+		write_queue.append(uri, uri_len);
+		write_queue.append(title, title_len);
+	}
+	cv.notify_one();
+}
+
+int history::open_log() const {
+	auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (fd == -1) {
+		g_warning("volo: %s: %s", path.c_str(), g_strerror(errno));
+	}
+	return fd;
+}
+
+// replay adds the records of the history log open as fd, of size bytes, to
+// idx, returning false if the log's header is not recognized.  Anything after
+// the last complete record is truncated.
+bool history::replay(int fd, size_t size, history_index& idx) const {
+	if (size < log_header_size) {
+		return false;
+	}
+	auto base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (base == MAP_FAILED) {
+		g_warning("volo: %s: %s", path.c_str(), g_strerror(errno));
+		return true;
+	}
+	madvise(base, size, MADV_SEQUENTIAL);
+	auto p = static_cast<const char *>(base);
+	uint32_t version;
+	memcpy(&version, p + sizeof(log_magic), sizeof(version));
+	if (memcmp(p, log_magic, sizeof(log_magic)) || version != log_version) {
+		munmap(base, size);
+		return false;
+	}
+
+	// good_off is the end of the last complete record.
+	std::string uri, title;
+	auto good_off = log_header_size;
+	for (auto off = log_header_size; off + 4 <= size; good_off = off) {
+		uint32_t len, uri_len;
+		int64_t time;
+		memcpy(&len, p + off, sizeof(len));
+		if (len < payload_fixed_size || len > size - off - 4) {
+			break;
+		}
+		auto payload = p + off + 4;
+		memcpy(&uri_len, payload + 9, sizeof(uri_len));
+		if (uri_len > len - payload_fixed_size) {
+			break;
+		}
+		off += 4 + len;
+		memcpy(&time, payload + 1, sizeof(time));
+		uri.assign(payload + payload_fixed_size, uri_len);
+		title.assign(payload + payload_fixed_size + uri_len,
+			len - payload_fixed_size - uri_len);
+		if (payload[0] == 'v') {
+			idx.add_visit(uri.c_str(), time);
+		} else if (payload[0] == 't') {
+			idx.set_title(uri.c_str(), title.c_str());
+		}
+	}
+	munmap(base, size);
+
+	// A record torn by a crash ends the log, and is truncated so that
+	// records appended from now on can be read.
+	if (good_off < size) {
+		g_warning("volo: truncating %zu bytes of torn history %s",
+			size - good_off, path.c_str());
+		if (ftruncate(fd, good_off) == -1) {
+			g_warning("volo: %s: %s", path.c_str(), g_strerror(errno));
+		}
+	}
+	return true;
+}
+
+// run loads the history log into a new index, hands it to the main thread,
+// and then appends queued records to the log until the history is
+// destroyed.
+void history::run() {
+	auto idx = std::unique_ptr<history_index>{new history_index};
+
+	auto fd = open_log();
+	struct stat st;
+	if (fd != -1 && fstat(fd, &st) == 0 && st.st_size != 0 &&
+		!replay(fd, static_cast<size_t>(st.st_size), *idx)) {
+
+		// Records appended to a log whose header is not recognized
+		// could never be read, so it is moved aside (in case it was
+		// written by another version) and a new log begun.
+		auto aside = path + ".unrecognized";
+		g_warning("volo: moving unrecognized history %s to %s",
+			path.c_str(), aside.c_str());
+		close(fd);
+		if (rename(path.c_str(), aside.c_str()) == -1) {
+			g_warning("volo: %s: %s", aside.c_str(), g_strerror(errno));
+			fd = -1;
+		} else {
+			fd = open_log();
+		}
+	}
+	if (fd != -1 && fstat(fd, &st) == 0 && st.st_size == 0) {
+		auto header = std::string{log_magic, sizeof(log_magic)};
+		put_u32(header, log_version);
+		if (write(fd, header.data(), header.size()) != ssize_t(header.size())) {
+			g_warning("volo: %s: %s", path.c_str(), g_strerror(errno));
+		}
+	}
+	idx->sort_prefixes();
+	idx->sort_ranks();
+
+	{
+		std::lock_guard<std::mutex> lock{mu};
+		loaded_index = std::move(idx);
+	}
+	gtk::idle_add(G_PRIORITY_DEFAULT_IDLE, *this, on_loaded);
+
+	std::string batch;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock{mu};
+			cv.wait(lock, [this] { return stopping || !write_queue.empty(); });
+			if (write_queue.empty() && stopping) {
+				break;
+			}
+			batch.swap(write_queue);
+		}
+		if (fd != -1 && write(fd, batch.data(), batch.size()) != ssize_t(batch.size())) {
+			g_warning("volo: writing history: %s", g_strerror(errno));
+		}
+		batch.clear();
+	}
+
+	if (fd != -1) {
+		close(fd);
+	}
+}
+
+void history::on_loaded() {
+	{
+		std::lock_guard<std::mutex> lock{mu};
+		for (auto& op : pending) {
+			if (op.title.empty()) {
+				loaded_index->add_visit(op.uri.c_str(), op.time);
+			} else {
+				loaded_index->set_title(op.uri.c_str(), op.title.c_str());
+			}
+		}
+		index = std::move(*loaded_index);
+		loaded_index.reset();
+	}
+	std::vector<pending_op>{}.swap(pending);
+	loaded = true;
+}
@@ -0,0 +1,166 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_HISTORY_H
+#define _VOLO_HISTORY_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <glib.h>
+
+#include <stall_monitor.h>
+
+namespace volo {
+
+// history_entry describes a visited URI.  rank is the log of the entry's
+// frecency: the sum over all visits of a weight which halves every
+// history_half_life seconds, scaled so that ranks of different entries can
+// be compared without knowing the current time.
+struct history_entry {
+	std::string uri;
+	std::string title;
+	uint32_t visits{0};
+	int64_t last_visit{0};
+	double rank{0};
+	// Offset of the URI with its scheme and any "www." removed.
+	uint32_t normalized{0};
+	// fuzzy::char_bag of the normalized URI and all titles.
+	uint64_t chars{0};
+
+	const char * normalized_uri() const { return uri.c_str() + normalized; }
+};
+
+// history_index is the in-memory index over all visited URIs.  Entries are
+// found by URI through an open addressing hash table, by URI prefix (with
+// the scheme and any "www." removed) through a sorted array, and by any
+// substring of at least three characters of the URI or title through a
+// trigram index of sorted posting lists.
+//
+// Queries matching a large fraction of all entries (such as a single
+// letter) are instead answered by scanning entries in order of decreasing
+// rank, stopping as soon as no later entry can place in the results.
+//
+// When fewer than the requested number of entries contain the query, the
+// results are filled with fuzzy matches: entries containing the query's
+// characters in order, found by scanning the highest ranked entries.
+class history_index {
+private:
+	std::vector<history_entry> entries;
+	// Entry ids plus one, or zero for an empty slot.
+	std::vector<uint32_t> uri_table;
+	std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;
+	// Entry ids sorted by normalized URI, and ids added since the last
+	// sort.
+	std::vector<uint32_t> by_prefix;
+	std::vector<uint32_t> unsorted;
+	// Entry ids sorted by decreasing rank.  Entries whose rank changed
+	// since the last sort are listed in rank_dirty, and their (stale)
+	// positions in by_rank are ignored.
+	std::vector<uint32_t> by_rank;
+	std::vector<uint32_t> rank_dirty;
+	std::vector<bool> is_rank_dirty;
+
+public:
+	// add_visit records a visit to uri at time (in seconds since the
+	// epoch), returning the entry's id.
+	uint32_t add_visit(const char *uri, int64_t time);
+
+	// set_title sets the title of the entry for uri, if one exists.
+	void set_title(const char *uri, const char *title);
+
+	// query finds the entries best matching text, by frecency, appending
+	// up to limit to results.  Entries whose normalized URI begins with
+	// the text are ranked above those matching elsewhere, and those
+	// containing it above fuzzy matches.
+	void query(const std::string& text, size_t limit,
+		std::vector<const history_entry *>& results);
+
+	size_t size() const { return entries.size(); }
+
+	// sort_prefixes and sort_ranks merge recently added or visited
+	// entries into the sorted prefix and rank arrays.
+	void sort_prefixes();
+	void sort_ranks();
+
+private:
+	uint32_t find(const char *uri, size_t len) const;
+	void insert_uri(uint32_t id);
+	void index_trigrams(uint32_t id, const char *text);
+	bool scan_by_rank(const std::string& q, size_t limit, size_t budget,
+		std::vector<std::pair<double, uint32_t>>& best);
+	void scan_fuzzy(const std::string& q, size_t limit,
+		const std::vector<std::pair<double, uint32_t>>& exclude,
+		std::vector<std::pair<double, uint32_t>>& best);
+};
+
+// history records visits in an on-disk log in the user's data directory and
+// answers queries from a history_index.  The log is read, and the index
+// built, on a background thread at startup; the same thread then appends
+// new records, so page loads never wait on the disk.  Visits recorded before
+// the index has been loaded are applied once it is ready.
+class history {
+private:
+	history_index index;
+	bool loaded{false};
+
+	// Operations applied before the loaded index replaces index.
+	struct pending_op {
+		std::string uri;
+		std::string title;
+		int64_t time;
+	};
+	std::vector<pending_op> pending;
+
+	std::string path;
+	std::thread thread;
+	std::mutex mu;
+	std::condition_variable cv;
+	std::string write_queue;
+	std::unique_ptr<history_index> loaded_index;
+	bool stopping{false};
+
+public:
+	history() {}
+	~history();
+
+	history(const history&) = delete;
+	history& operator=(const history&) = delete;
+
+	// open begins loading the history log and starts the writer.
+	void open();
+
+	// record_visit records a visit to uri now.  set_title records a
+	// change of the title of uri.
+	void record_visit(const char *uri);
+	void set_title(const char *uri, const char *title);
+
+	void query(const std::string& text, size_t limit,
+		std::vector<const history_entry *>& results) {
+		index.query(text, limit, results);
+	}
+
+private:
+	void append(char type, int64_t time, const char *uri, const char *title);
+	void run();
+	int open_log() const;
+	bool replay(int fd, size_t size, history_index&) const;
+	void on_loaded();
+
+	static gboolean on_loaded(history *h) {
+		slot_timer t{"history::on_loaded"};
+		h->on_loaded();
+		return G_SOURCE_REMOVE;
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_HISTORY_H
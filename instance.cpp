@@ -0,0 +1,153 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+
+#include <encoding.h>
+#include <instance.h>
+#include <uri_reader.h>
+#include <volo.h>
+
+using namespace volo;
+
+static bool make_address(const std::string& path, sockaddr_un& addr) {
+	if (path.size() >= sizeof(addr.sun_path)) {
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+	return true;
+}
+
+instance::instance() {
+	auto path = g_build_filename(g_get_user_runtime_dir(), "volo.sock", nullptr);
+	this->path = path;
+	g_free(path);
+}
+
+instance::~instance() {
+	if (listen_fd != -1) {
+		close(listen_fd);
+		unlink(path.c_str());
+	}
+}
+
+int instance::connect() const {
+	sockaddr_un addr;
+	if (!make_address(path, addr)) {
+		return -1;
+	}
+
+	auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		return -1;
+	}
+	if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool instance::forward(const std::vector<const char *>& uris, int uri_fd) {
+	auto fd = connect();
+	if (fd == -1) {
+		return false;
+	}
+
+	// An instance exiting as URIs are sent fails the writes, rather
+	// than killing this process.
+	signal(SIGPIPE, SIG_IGN);
+
+	auto ok = true;
+	for (auto uri : uris) {
+		if (*uri && ok) {
+			ok = write_all(fd, uri, strlen(uri)) && write_all(fd, "\n", 1);
+		}
+	}
+	if (uri_fd != -1) {
+		char buf[64 * 1024];
+		while (ok) {
+			auto n = read(uri_fd, buf, sizeof(buf));
+			if (n == -1 && errno == EINTR) {
+				continue;
+			}
+			if (n <= 0) {
+				break;
+			}
+			ok = write_all(fd, buf, n);
+		}
+		// Terminate a final line lacking a newline.
+		ok = ok && write_all(fd, "\n", 1);
+	}
+	if (!ok) {
+		g_warning("volo: forwarding URIs: %s", g_strerror(errno));
+	}
+
+	close(fd);
+	return ok;
+}
+
+bool instance::listen(browser& b) {
+	sockaddr_un addr;
+	if (!make_address(path, addr)) {
+		return false;
+	}
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (listen_fd == -1) {
+		return false;
+	}
+
+	auto old_mask = umask(077);
+	auto rv = bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+	if (rv == -1 && errno == EADDRINUSE) {
+		// A socket left behind by an instance that did not exit
+		// cleanly is removed.  A live instance (started after our
+		// attempt to forward) is left alone.
+		auto fd = connect();
+		if (fd == -1) {
+			unlink(path.c_str());
+			rv = bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+		} else {
+			close(fd);
+		}
+	}
+	umask(old_mask);
+
+	if (rv == -1 || ::listen(listen_fd, 16) == -1) {
+		close(listen_fd);
+		listen_fd = -1;
+		return false;
+	}
+
+	this->b = &b;
+	g_unix_fd_add(listen_fd, G_IO_IN, on_listen_readable, this);
+	return true;
+}
+
+bool instance::on_listen_readable() {
+	for (;;) {
+		auto fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		b->present();
+		uri_reader::watch(fd, *b);
+	}
+	return G_SOURCE_CONTINUE;
+}
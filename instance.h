@@ -0,0 +1,62 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_INSTANCE_H
+#define _VOLO_INSTANCE_H
+
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include <stall_monitor.h>
+
+namespace volo {
+
+class browser;
+
+// instance implements single-instance mode.  The first volo process for a
+// user listens on a Unix domain socket in the user's runtime directory.
+// Later invocations connect to it and forward their URIs, newline
+// separated, before exiting, instead of initializing GTK and WebKit.
+class instance {
+private:
+	std::string path;
+	int listen_fd{-1};
+	browser *b{nullptr};
+
+public:
+	instance();
+	~instance();
+
+	instance(const instance&) = delete;
+	instance& operator=(const instance&) = delete;
+
+	// forward sends uris, followed by any URIs read from uri_fd (if not
+	// -1), to a running instance.  It returns false without sending
+	// anything if no instance is listening, and also if the URIs could
+	// not all be sent, as when the instance exits.  Empty URIs are not
+	// sent; a forwarded connection without any URIs only raises the
+	// window of the running instance.
+	bool forward(const std::vector<const char *>& uris, int uri_fd);
+
+	// listen begins accepting forwarded URIs on the main loop, queueing
+	// them to be opened in b.  It returns false if the socket could not
+	// be created, in which case the browser runs as an independent
+	// instance.
+	bool listen(browser& b);
+
+private:
+	int connect() const;
+	bool on_listen_readable();
+
+	static gboolean on_listen_readable(int, GIOCondition, gpointer inst) {
+		slot_timer t{"instance::on_listen_readable"};
+		return static_cast<instance *>(inst)->on_listen_readable();
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_INSTANCE_H
@@ -0,0 +1,183 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <load_stats.h>
+
+using namespace volo;
+
+unsigned int load_histogram::bucket(gint64 duration) {
+	if (duration < 1000) {
+		return 0;
+	}
+	auto b = 1 + static_cast<unsigned int>(4 * std::log2(duration / 1000.0));
+	return std::min(b, num_buckets - 1);
+}
+
+double load_histogram::bucket_limit(unsigned int b) {
+	return std::exp2(b / 4.0);
+}
+
+void load_histogram::add(gint64 duration, gint64 now) {
+	const auto n = now / epoch_length;
+	auto& e = epochs[n % num_epochs];
+	if (e.number != n) {
+		e.number = n;
+		e.counts.fill(0);
+	}
+	++e.counts[bucket(duration)];
+}
+
+load_histogram::summary load_histogram::summarize(gint64 now) const {
+	const auto n = now / epoch_length;
+	std::array<unsigned long, num_buckets> counts{};
+	summary s;
+	for (auto& e : epochs) {
+		if (e.number < 0 || e.number > n || n - e.number >= num_epochs) {
+			continue;
+		}
+		for (unsigned int b = 0; b < num_buckets; ++b) {
+			counts[b] += e.counts[b];
+			s.count += e.counts[b];
+		}
+	}
+	if (!s.count) {
+		return s;
+	}
+
+	// Find the bucket holding each percentile, in one pass as they are
+	// in increasing order.
+	const std::array<std::pair<double, double *>, 3> percentiles = { {
+		{0.50, &s.p50},
+		{0.90, &s.p90},
+		{0.99, &s.p99},
+	} };
+	unsigned long seen = 0;
+	unsigned int b = 0;
+	for (auto& p : percentiles) {
+		const auto rank = static_cast<unsigned long>(std::ceil(p.first * s.count));
+		while (seen + counts[b] < rank) {
+			seen += counts[b++];
+		}
+		*p.second = bucket_limit(b);
+	}
+	return s;
+}
+
+void load_stats::open(const char *path) {
+	if (path) {
+		this->path = path;
+		return;
+	}
+	auto dir = g_build_filename(g_get_user_data_dir(), "volo", nullptr);
+	g_mkdir_with_parents(dir, 0700);
+	auto p = g_build_filename(dir, "load-stats", nullptr);
+	this->path = p;
+	g_free(p);
+	g_free(dir);
+}
+
+void load_stats::record(const std::string& host, const load_timing& timing) {
+	if (host.empty() || !timing.started || !timing.finished) {
+		return;
+	}
+
+	auto h = hosts.find(host);
+	if (h == hosts.end()) {
+		if (hosts.size() >= max_hosts) {
+			forget_idle_hosts(timing.finished);
+		}
+		if (hosts.size() < max_hosts) {
+			h = hosts.emplace(host, host_stats{}).first;
+		}
+	}
+
+	for (auto stats : { &total, h != hosts.end() ? &h->second : nullptr }) {
+		if (!stats) {
+			continue;
+		}
+		if (timing.committed) {
+			stats->commit.add(timing.committed - timing.started, timing.finished);
+			stats->finish.add(timing.finished - timing.started, timing.finished);
+		} else {
+			stats->fail.add(timing.finished - timing.started, timing.finished);
+		}
+	}
+}
+
+void load_stats::forget_idle_hosts(gint64 now) {
+	for (auto it = hosts.begin(); it != hosts.end();) {
+		auto& s = it->second;
+		if (!s.commit.summarize(now).count && !s.fail.summarize(now).count) {
+			it = hosts.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void load_stats::add_section(std::function<void(std::string&)> section) {
+	sections.push_back(std::move(section));
+}
+
+bool load_stats::dump() const {
+	if (path.empty()) {
+		return false;
+	}
+
+	const auto now = g_get_monotonic_time();
+	const auto window = load_histogram::num_epochs * load_histogram::epoch_length /
+		(60 * G_USEC_PER_SEC);
+	auto out = std::string{};
+	char line[512];
+	snprintf(line, sizeof(line), "# page load milliseconds over the last %lld minutes\n"
+		"# host measurement count p50 p90 p99\n", static_cast<long long>(window));
+	out += line;
+
+	auto append = [&](const char *host, const host_stats& stats) {
+		const std::array<std::pair<const char *, const load_histogram *>, 3> measurements = { {
+			{"commit", &stats.commit},
+			{"finish", &stats.finish},
+			{"fail", &stats.fail},
+		} };
+		for (auto& m : measurements) {
+			auto s = m.second->summarize(now);
+			if (!s.count) {
+				continue;
+			}
+			snprintf(line, sizeof(line), "%s %s %lu %.0f %.0f %.0f\n", host, m.first,
+				s.count, s.p50, s.p90, s.p99);
+			out += line;
+		}
+	};
+
+	// The total is listed first under the host "*", followed by each
+	// host in order, so that dumps may be compared with diff.
+	append("*", total);
+	std::vector<const std::pair<const std::string, host_stats> *> sorted;
+	sorted.reserve(hosts.size());
+	for (auto& h : hosts) {
+		sorted.push_back(&h);
+	}
+	std::sort(sorted.begin(), sorted.end(),
+		[](auto a, auto b) { return a->first < b->first; });
+	for (auto h : sorted) {
+		append(h->first.c_str(), h->second);
+	}
+	for (auto& section : sections) {
+		section(out);
+	}
+
+	GError *error = nullptr;
+	if (!g_file_set_contents(path.c_str(), out.data(), out.size(), &error)) {
+		g_warning("volo: writing load stats: %s", error->message);
+		g_error_free(error);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_LOAD_STATS_H
+#define _VOLO_LOAD_STATS_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glib.h>
+
+namespace volo {
+
+// load_timing records the monotonic time (in microseconds) of each event of a
+// page load, or zero for events which have not occurred.  Only the last of
+// any redirects is timed.
+struct load_timing {
+	gint64 started{0};
+	gint64 redirected{0};
+	gint64 committed{0};
+	gint64 finished{0};
+	unsigned int redirects{0};
+};
+
+// load_histogram counts durations over a rolling window of time.  Durations
+// are counted in buckets a quarter octave wide, from one millisecond to a
+// little over two minutes, with all shorter and longer durations counted by
+// the first and last buckets.  The window is divided into epochs, the oldest
+// of which is dropped as each new epoch begins.
+class load_histogram {
+public:
+	static const unsigned int num_buckets = 4 * 17 + 2;
+	static const unsigned int num_epochs = 6;
+	static const gint64 epoch_length = 10 * 60 * G_USEC_PER_SEC;
+
+	// summary describes the durations counted in the window.
+	// Percentiles are the upper bound (in milliseconds) of the bucket
+	// holding them, and are zero when nothing was counted.
+	struct summary {
+		unsigned long count{0};
+		double p50{0};
+		double p90{0};
+		double p99{0};
+	};
+
+private:
+	struct epoch {
+		gint64 number{-1};
+		std::array<uint32_t, num_buckets> counts{};
+	};
+	std::array<epoch, num_epochs> epochs;
+
+public:
+	// add counts a duration ending at the monotonic time now.
+	void add(gint64 duration, gint64 now);
+
+	// summarize describes the durations counted in the window ending at
+	// the monotonic time now.
+	summary summarize(gint64 now) const;
+
+	// bucket returns the bucket counting a duration, and bucket_limit
+	// the upper bound of a bucket in milliseconds.
+	static unsigned int bucket(gint64 duration);
+	static double bucket_limit(unsigned int);
+};
+
+// load_stats keeps histograms of the time from starting a page load until it
+// was committed, and until it finished, both in total and for each host.
+// Loads which finish without being committed have failed, and the time until
+// they finished is counted separately.
+//
+// The histograms may be written to a stats file as text, with one line for
+// each host and measurement, followed by any other sections of stats added
+// to it.  The file is replaced at each dump.
+class load_stats {
+private:
+	struct host_stats {
+		load_histogram commit;
+		load_histogram finish;
+		load_histogram fail;
+	};
+	host_stats total;
+	std::unordered_map<std::string, host_stats> hosts;
+	std::string path;
+	std::vector<std::function<void(std::string&)>> sections;
+
+public:
+	// Hosts without loads in the window are forgotten once this many
+	// hosts are recorded.
+	static const size_t max_hosts = 1024;
+
+	// open sets the stats file, the default for which is in the user
+	// data directory.
+	void open(const char *path = nullptr);
+
+	// record adds a finished page load of host to the histograms.
+	// Loads without a host, such as of blank pages, are ignored.
+	void record(const std::string& host, const load_timing&);
+
+	// add_section adds a function appending lines of other stats to
+	// each dump.
+	void add_section(std::function<void(std::string&)>);
+
+	// dump writes all histograms and sections to the stats file,
+	// returning false if it could not be written.
+	bool dump() const;
+
+private:
+	void forget_idle_hosts(gint64 now);
+};
+
+} // namespace volo
+
+#endif // _VOLO_LOAD_STATS_H
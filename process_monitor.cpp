@@ -0,0 +1,210 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <process_monitor.h>
+
+using namespace volo;
+
+// Name of WebKit's web process, as truncated in /proc/pid/stat.
+static const char web_process_name[] = "WebKitWebProces";
+
+struct proc_stat {
+	pid_t pid;
+	pid_t ppid;
+	// User and system CPU time, in clock ticks.
+	uint64_t ticks;
+	// Time the process started after boot, in clock ticks.
+	uint64_t start;
+	bool is_web_process;
+};
+
+// read_file reads up to size-1 bytes of a file into buf, NUL terminating
+// it, and returns the number of bytes read or -1 on error.
+static ssize_t read_file(const char *path, char *buf, size_t size) {
+	auto fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return -1;
+	}
+	auto n = read(fd, buf, size - 1);
+	close(fd);
+	if (n >= 0) {
+		buf[n] = '\0';
+	}
+	return n;
+}
+
+// read_stat parses /proc/pid/stat.  The command name may itself contain
+// spaces and parentheses, so the fields following it are found from the
+// last closing parenthesis.
+static bool read_stat(pid_t pid, proc_stat& st) {
+	char path[64], buf[1024];
+	snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+	if (read_file(path, buf, sizeof(buf)) <= 0) {
+		return false;
+	}
+	auto comm = strchr(buf, '(');
+	auto comm_end = strrchr(buf, ')');
+	if (!comm || !comm_end || comm_end < comm) {
+		return false;
+	}
+	++comm;
+
+	int ppid;
+	unsigned long long utime, stime, start;
+	if (sscanf(comm_end + 1, " %*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu "
+		"%*d %*d %*d %*d %*d %*d %llu", &ppid, &utime, &stime, &start) != 4) {
+
+		return false;
+	}
+	st.pid = pid;
+	st.ppid = ppid;
+	st.ticks = utime + stime;
+	st.start = start;
+	st.is_web_process = size_t(comm_end - comm) == strlen(web_process_name) &&
+		!strncmp(comm, web_process_name, comm_end - comm);
+	return true;
+}
+
+// read_memory reads the resident and proportional set sizes of a process.
+// The proportional size is left zero if the kernel does not report it.
+static void read_memory(pid_t pid, uint64_t& rss, uint64_t& pss) {
+	char path[64], buf[4096];
+	static const auto page_size = sysconf(_SC_PAGESIZE);
+
+	rss = pss = 0;
+	snprintf(path, sizeof(path), "/proc/%d/statm", static_cast<int>(pid));
+	unsigned long long size, resident;
+	if (read_file(path, buf, sizeof(buf)) > 0 &&
+		sscanf(buf, "%llu %llu", &size, &resident) == 2) {
+
+		rss = resident * page_size;
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", static_cast<int>(pid));
+	if (read_file(path, buf, sizeof(buf)) > 0) {
+		auto line = strstr(buf, "\nPss:");
+		unsigned long long kb;
+		if (line && sscanf(line + 5, "%llu", &kb) == 1) {
+			pss = kb << 10;
+		}
+	}
+}
+
+void process_monitor::view_created(const webkit::web_view& wv) {
+	views[&wv];
+	unmatched.push_back(&wv);
+}
+
+void process_monitor::view_destroyed(const webkit::web_view& wv) {
+	views.erase(&wv);
+	unmatched.erase(std::remove(unmatched.begin(), unmatched.end(), &wv),
+		unmatched.end());
+}
+
+const process_usage *process_monitor::usage(const webkit::web_view& wv) const {
+	auto it = views.find(&wv);
+	return it != views.end() && it->second.usage.pid ? &it->second.usage : nullptr;
+}
+
+void process_monitor::sample() {
+	// Read the stat of every process to find the web processes which
+	// descend from this one.
+	std::vector<proc_stat> procs;
+	auto dir = opendir("/proc");
+	if (!dir) {
+		return;
+	}
+	while (auto ent = readdir(dir)) {
+		char *end;
+		auto pid = strtol(ent->d_name, &end, 10);
+		proc_stat st;
+		if (*end == '\0' && pid > 0 && read_stat(pid, st)) {
+			procs.push_back(st);
+		}
+	}
+	closedir(dir);
+
+	std::unordered_set<pid_t> descendants{getpid()};
+	for (bool grew = true; grew;) {
+		grew = false;
+		for (auto& p : procs) {
+			if (!descendants.count(p.pid) && descendants.count(p.ppid)) {
+				descendants.insert(p.pid);
+				grew = true;
+			}
+		}
+	}
+	std::unordered_map<pid_t, const proc_stat *> web;
+	for (auto& p : procs) {
+		if (p.is_web_process && descendants.count(p.pid)) {
+			web.emplace(p.pid, &p);
+		}
+	}
+
+	// Forget processes which have exited, returning their web_views to
+	// be matched again.
+	for (auto& v : views) {
+		auto& usage = v.second.usage;
+		if (usage.pid && !web.count(usage.pid)) {
+			usage = process_usage{};
+			unmatched.push_back(v.first);
+		}
+	}
+	for (auto it = known.begin(); it != known.end();) {
+		it = web.count(*it) ? std::next(it) : known.erase(it);
+	}
+
+	// Match new processes, in the order they started, to web_views in
+	// the order they were created.
+	std::vector<const proc_stat *> started;
+	for (auto& w : web) {
+		if (!known.count(w.first)) {
+			started.push_back(w.second);
+			known.insert(w.first);
+		}
+	}
+	std::sort(started.begin(), started.end(),
+		[](auto a, auto b) { return a->start < b->start; });
+	const auto now = g_get_monotonic_time();
+	const auto unambiguous = started.size() == 1 && unmatched.size() == 1;
+	for (auto p : started) {
+		if (unmatched.empty()) {
+			break;
+		}
+		auto& t = views[unmatched.front()];
+		unmatched.pop_front();
+		t.usage.pid = p->pid;
+		t.usage.unambiguous = unambiguous && !t.rematch;
+		t.rematch = true;
+		t.ticks = p->ticks;
+		t.sampled = now;
+	}
+
+	static const auto ticks_per_sec = sysconf(_SC_CLK_TCK);
+	for (auto& v : views) {
+		auto& t = v.second;
+		if (!t.usage.pid) {
+			continue;
+		}
+		read_memory(t.usage.pid, t.usage.rss, t.usage.pss);
+		auto ticks = web[t.usage.pid]->ticks;
+		if (now > t.sampled) {
+			t.usage.cpu = 100.0 * (ticks - t.ticks) / ticks_per_sec /
+				((now - t.sampled) / double(G_USEC_PER_SEC));
+		}
+		t.ticks = ticks;
+		t.sampled = now;
+	}
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_PROCESS_MONITOR_H
+#define _VOLO_PROCESS_MONITOR_H
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <sys/types.h>
+
+#include <glib.h>
+
+#include <webkit.h>
+
+namespace volo {
+
+// process_usage describes the resources used by a web process.  Memory is
+// in bytes, and cpu is the percentage of one CPU used since the previous
+// sample.  unambiguous is set when the process was the only one started, and
+// the web_view the only one waiting for a process, in the sample which
+// matched them, and the web_view had not been matched to a process before.
+struct process_usage {
+	pid_t pid{0};
+	uint64_t rss{0};
+	uint64_t pss{0};
+	double cpu{0};
+	bool unambiguous{false};
+};
+
+// process_monitor samples the memory and CPU use of the web process of each
+// web_view from /proc.
+//
+// WebKit does not expose the process of a web_view.  With a web process for
+// each web_view, a web_view's process is started shortly after the web_view
+// is created, so web processes descending from this process are matched to
+// web_views in the order each was created and started.  A web_view whose
+// process exits (after a crash) is matched to the next new process again.
+// Web_views sharing the process of a related web_view are not matched.
+//
+// Matches are only guesses when several processes start at once (as when a
+// process is prewarmed, or several web_views are created together), or when
+// a web_view's process is replaced, such as on navigation to another site.
+// Such matches are not unambiguous, and are only fit for reporting usage,
+// not for acting on the process.
+class process_monitor {
+private:
+	struct tracked {
+		process_usage usage;
+		// CPU time (in clock ticks) and monotonic time of the last
+		// sample.
+		uint64_t ticks{0};
+		gint64 sampled{0};
+		// Whether the web_view has been matched to a process before.
+		bool rematch{false};
+	};
+	std::unordered_map<const webkit::web_view *, tracked> views;
+	// Web_views not yet matched to a process, in order of creation.
+	std::deque<const webkit::web_view *> unmatched;
+	// Web processes already seen, whether matched or not.
+	std::unordered_set<pid_t> known;
+
+public:
+	// view_created and view_destroyed must be called as each web_view
+	// is created and destroyed.
+	void view_created(const webkit::web_view&);
+	void view_destroyed(const webkit::web_view&);
+
+	// sample matches new web processes to web_views and samples the
+	// usage of every matched process.
+	void sample();
+
+	// usage returns the last sampled usage of a web_view's process, or
+	// null if it is not matched to one.
+	const process_usage *usage(const webkit::web_view&) const;
+};
+
+} // namespace volo
+
+#endif // _VOLO_PROCESS_MONITOR_H
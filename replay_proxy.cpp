@@ -0,0 +1,325 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <replay_proxy.h>
+
+using namespace volo;
+
+// Interval between the chunks of a bandwidth shaped body, in milliseconds.
+static const unsigned int shaping_interval = 50;
+
+// Headers which describe a single connection, rather than the response, and
+// so are not forwarded or recorded.  The length of a body is set when it is
+// sent.
+static const char *const connection_headers[] = {
+	"Connection",
+	"Content-Length",
+	"Keep-Alive",
+	"Proxy-Authenticate",
+	"Proxy-Authorization",
+	"Proxy-Connection",
+	"TE",
+	"Trailer",
+	"Transfer-Encoding",
+	"Upgrade",
+};
+
+static bool is_connection_header(const char *name) {
+	return std::any_of(std::begin(connection_headers), std::end(connection_headers),
+		[name](const char *h) { return !g_ascii_strcasecmp(h, name); });
+}
+
+static void copy_header(const char *name, const char *value, gpointer headers) {
+	if (!is_connection_header(name)) {
+		soup_message_headers_append(static_cast<SoupMessageHeaders *>(headers),
+			name, value);
+	}
+}
+
+static void append_header_line(const char *name, const char *value, gpointer head) {
+	if (!is_connection_header(name)) {
+		*static_cast<std::string *>(head) += std::string{name} + ": " + value + '\n';
+	}
+}
+
+// forward is a request being forwarded while recording, whose server
+// message is paused until the response arrives.
+struct forward {
+	SoupServer *server;
+	SoupMessage *msg;
+	std::string head_path;
+	std::string body_path;
+};
+
+// transfer is a replayed response being shaped.  The server message is
+// paused between chunks, and the transfer is freed once the message is
+// finished, whether completely sent or not.
+struct transfer {
+	SoupServer *server;
+	SoupMessage *msg;
+	GMainContext *context;
+	SoupBuffer *body;
+	gsize sent{0};
+	gsize chunk_size{0};
+	GSource *timer{nullptr};
+};
+
+static void schedule(transfer&, unsigned int ms);
+
+// on_transfer_timeout begins a shaped response once its latency has passed,
+// and then appends one chunk of its body at each interval.
+static gboolean on_transfer_timeout(gpointer data) {
+	auto& t = *static_cast<transfer *>(data);
+	g_source_unref(t.timer);
+	t.timer = nullptr;
+
+	const auto n = t.chunk_size ? std::min(t.chunk_size, t.body->length - t.sent) :
+		t.body->length - t.sent;
+	if (n) {
+		soup_message_body_append(t.msg->response_body, SOUP_MEMORY_COPY,
+			t.body->data + t.sent, n);
+		t.sent += n;
+	}
+	if (t.sent == t.body->length) {
+		soup_message_body_complete(t.msg->response_body);
+	} else {
+		schedule(t, shaping_interval);
+	}
+	soup_server_unpause_message(t.server, t.msg);
+	return G_SOURCE_REMOVE;
+}
+
+static void schedule(transfer& t, unsigned int ms) {
+	t.timer = g_timeout_source_new(ms);
+	g_source_set_callback(t.timer, on_transfer_timeout, &t, nullptr);
+	g_source_attach(t.timer, t.context);
+}
+
+static void on_transfer_finished(SoupMessage *msg, gpointer data) {
+	auto t = static_cast<transfer *>(data);
+	if (t->timer) {
+		g_source_destroy(t->timer);
+		g_source_unref(t->timer);
+	}
+	g_signal_handlers_disconnect_by_data(msg, t);
+	soup_buffer_free(t->body);
+	g_object_unref(t->msg);
+	delete t;
+}
+
+replay_proxy::replay_proxy(mode how, std::string dir, const replay_shaping& shaping) :
+	how{how}, dir{std::move(dir)}, shaping{shaping} {}
+
+replay_proxy::~replay_proxy() {
+	if (thread.joinable()) {
+		g_main_loop_quit(loop);
+		thread.join();
+	}
+	if (server) {
+		soup_server_disconnect(server);
+		g_object_unref(server);
+	}
+	if (session) {
+		g_object_unref(session);
+	}
+	if (loop) {
+		g_main_loop_unref(loop);
+	}
+	if (context) {
+		g_main_context_unref(context);
+	}
+}
+
+bool replay_proxy::start() {
+	if (how == mode::record && g_mkdir_with_parents(dir.c_str(), 0700) == -1) {
+		g_warning("volo: %s: %s", dir.c_str(), g_strerror(errno));
+		return false;
+	}
+
+	// The server and session attach their sources to the thread default
+	// main context, which is the proxy's own while they are created.
+	context = g_main_context_new();
+	loop = g_main_loop_new(context, false);
+	g_main_context_push_thread_default(context);
+	server = soup_server_new(nullptr, nullptr);
+	soup_server_add_handler(server, nullptr, on_request, this, nullptr);
+	GError *error = nullptr;
+	auto ok = soup_server_listen_local(server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error);
+	if (ok && how == mode::record) {
+		// Bodies are recorded as they were sent, still encoded.
+		session = soup_session_new();
+		soup_session_remove_feature_by_type(session, SOUP_TYPE_CONTENT_DECODER);
+	}
+	g_main_context_pop_thread_default(context);
+	if (!ok) {
+		g_warning("volo: starting replay proxy: %s", error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	auto uris = soup_server_get_uris(server);
+	port = soup_uri_get_port(static_cast<SoupURI *>(uris->data));
+	g_slist_free_full(uris, reinterpret_cast<GDestroyNotify>(soup_uri_free));
+	uri = "http://127.0.0.1:" + std::to_string(port) + "/";
+
+	thread = std::thread{&replay_proxy::run, this};
+	return true;
+}
+
+void replay_proxy::run() {
+	g_main_context_push_thread_default(context);
+	g_main_loop_run(loop);
+	g_main_context_pop_thread_default(context);
+}
+
+// archive_path returns the path of the archived head or body of the response
+// to a request, named for a hash of its method and URI.
+std::string replay_proxy::archive_path(const char *method, SoupURI *uri,
+	const char *ext) const {
+
+	auto uri_str = soup_uri_to_string(uri, false);
+	auto key = std::string{method} + ' ' + uri_str;
+	g_free(uri_str);
+	auto hash = g_compute_checksum_for_string(G_CHECKSUM_SHA256, key.c_str(), key.size());
+	auto path = dir + '/' + hash + ext;
+	g_free(hash);
+	return path;
+}
+
+void replay_proxy::on_request(SoupServer *server, SoupMessage *msg, const char *,
+	GHashTable *, SoupClientContext *, gpointer data) {
+
+	auto& proxy = *static_cast<replay_proxy *>(data);
+	auto uri = soup_message_get_uri(msg);
+
+	if (msg->method == SOUP_METHOD_CONNECT) {
+		soup_message_set_status(msg, SOUP_STATUS_NOT_IMPLEMENTED);
+		return;
+	}
+	// A request to the proxy itself was not made through it.
+	if (uri->scheme != SOUP_URI_SCHEME_HTTP ||
+		(soup_uri_get_port(uri) == proxy.port &&
+		!strcmp(soup_uri_get_host(uri), "127.0.0.1"))) {
+
+		soup_message_set_status(msg, SOUP_STATUS_BAD_REQUEST);
+		return;
+	}
+
+	if (proxy.how == mode::record) {
+		proxy.record(msg, uri);
+	} else {
+		proxy.replay(msg, uri);
+	}
+}
+
+static void on_forwarded(SoupSession *, SoupMessage *fwd, gpointer data) {
+	auto f = static_cast<forward *>(data);
+	auto msg = f->msg;
+
+	if (SOUP_STATUS_IS_TRANSPORT_ERROR(fwd->status_code)) {
+		soup_message_set_status(msg, SOUP_STATUS_BAD_GATEWAY);
+	} else {
+		soup_message_set_status_full(msg, fwd->status_code, fwd->reason_phrase);
+		soup_message_headers_foreach(fwd->response_headers, copy_header,
+			msg->response_headers);
+		auto body = soup_message_body_flatten(fwd->response_body);
+		soup_message_body_append_buffer(msg->response_body, body);
+
+		// The body is written before the head, whose presence marks
+		// a complete recording.
+		auto head = std::to_string(fwd->status_code) + ' ' +
+			(fwd->reason_phrase ? fwd->reason_phrase : "") + '\n';
+		soup_message_headers_foreach(fwd->response_headers, append_header_line, &head);
+		GError *error = nullptr;
+		if (!g_file_set_contents(f->body_path.c_str(), body->data, body->length, &error) ||
+			!g_file_set_contents(f->head_path.c_str(), head.data(), head.size(), &error)) {
+
+			g_warning("volo: recording response: %s", error->message);
+			g_error_free(error);
+		}
+		soup_buffer_free(body);
+	}
+
+	soup_server_unpause_message(f->server, msg);
+	g_object_unref(msg);
+	delete f;
+}
+
+// record forwards a request, and serves and records its response once it
+// arrives.  Redirects are not followed, so that the browser sees and
+// records each response.
+void replay_proxy::record(SoupMessage *msg, SoupURI *uri) {
+	auto fwd = soup_message_new_from_uri(msg->method, uri);
+	soup_message_set_flags(fwd, SOUP_MESSAGE_NO_REDIRECT);
+	soup_message_headers_foreach(msg->request_headers, copy_header,
+		fwd->request_headers);
+	if (msg->request_body->length) {
+		auto body = soup_message_body_flatten(msg->request_body);
+		soup_message_body_append_buffer(fwd->request_body, body);
+		soup_buffer_free(body);
+	}
+
+	auto f = new forward{server, msg, archive_path(msg->method, uri, ".head"),
+		archive_path(msg->method, uri, ".body")};
+	g_object_ref(msg);
+	soup_server_pause_message(server, msg);
+	soup_session_queue_message(session, fwd, on_forwarded, f);
+}
+
+// replay serves the recorded response to a request, shaped as configured.
+void replay_proxy::replay(SoupMessage *msg, SoupURI *uri) {
+	gchar *head, *body;
+	gsize body_len;
+	if (!g_file_get_contents(archive_path(msg->method, uri, ".head").c_str(), &head,
+		nullptr, nullptr)) {
+
+		soup_message_set_status_full(msg, SOUP_STATUS_NOT_FOUND, "Not Recorded");
+		return;
+	}
+	if (!g_file_get_contents(archive_path(msg->method, uri, ".body").c_str(), &body,
+		&body_len, nullptr)) {
+
+		body = nullptr;
+		body_len = 0;
+	}
+
+	// The head is the status code and reason, followed by a line for
+	// each header.
+	auto lines = g_strsplit(head, "\n", -1);
+	g_free(head);
+	char *reason;
+	auto status = strtoul(lines[0], &reason, 10);
+	soup_message_set_status_full(msg, status, reason + strspn(reason, " "));
+	for (auto line = lines + 1; *line; ++line) {
+		if (auto sep = strstr(*line, ": ")) {
+			*sep = '\0';
+			soup_message_headers_append(msg->response_headers, *line, sep + 2);
+		}
+	}
+	g_strfreev(lines);
+
+	auto buf = soup_buffer_new(SOUP_MEMORY_TAKE, body, body_len);
+	if (!shaping.latency && !shaping.bytes_per_sec) {
+		soup_message_body_append_buffer(msg->response_body, buf);
+		soup_buffer_free(buf);
+		return;
+	}
+
+	// A shaped body is streamed, so its length is set beforehand.
+	auto t = new transfer{server, msg, context, buf};
+	if (shaping.bytes_per_sec) {
+		t->chunk_size = std::max(1u, shaping.bytes_per_sec / (1000 / shaping_interval));
+	}
+	soup_message_headers_set_content_length(msg->response_headers, body_len);
+	soup_message_body_set_accumulate(msg->response_body, false);
+	g_object_ref(msg);
+	g_signal_connect(msg, "finished", G_CALLBACK(on_transfer_finished), t);
+	soup_server_pause_message(server, msg);
+	schedule(*t, shaping.latency);
+}
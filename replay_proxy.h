@@ -0,0 +1,86 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_REPLAY_PROXY_H
+#define _VOLO_REPLAY_PROXY_H
+
+#include <string>
+#include <thread>
+
+#include <libsoup/soup.h>
+
+namespace volo {
+
+// replay_shaping delays and slows the responses replayed from an archive.
+// Each response waits latency milliseconds before it is begun, and when
+// bytes_per_sec is nonzero, its body is sent no faster than that.  Every
+// response is shaped on its own, rather than sharing one link.
+struct replay_shaping {
+	unsigned int latency{0};
+	unsigned int bytes_per_sec{0};
+};
+
+// replay_proxy is an HTTP proxy on the loopback interface which records the
+// responses to every request in an archive, or replays them from it, so that
+// page loads may be measured reproducibly and without a network.
+//
+// The archive is a directory with a pair of files for each method and URI:
+// the response's status line and headers, and its body.  When recording,
+// every request is forwarded and its response saved, replacing any earlier
+// response to the same method and URI.  When replaying, the recorded
+// responses are served and requests which were not recorded fail with 404.
+// Request bodies are forwarded but do not distinguish responses.
+//
+// Only plain HTTP is proxied.  HTTPS is tunneled through a proxy with
+// CONNECT, so its responses cannot be recorded, and tunnels are refused.
+//
+// The proxy runs its own main loop on a thread of its own, so serving and
+// shaping responses never waits for the browser's main loop.
+class replay_proxy {
+public:
+	enum class mode {
+		record,
+		replay,
+	};
+
+private:
+	mode how;
+	std::string dir;
+	replay_shaping shaping;
+	std::string uri;
+	unsigned int port{0};
+	GMainContext *context{nullptr};
+	GMainLoop *loop{nullptr};
+	SoupServer *server{nullptr};
+	SoupSession *session{nullptr};
+	std::thread thread;
+
+public:
+	replay_proxy(mode, std::string dir, const replay_shaping& = {});
+	~replay_proxy();
+
+	replay_proxy(const replay_proxy&) = delete;
+	replay_proxy& operator=(const replay_proxy&) = delete;
+
+	// start listens on a free port of the loopback interface and begins
+	// serving requests, returning false on error.
+	bool start();
+
+	// proxy_uri returns the URI by which web contexts use the proxy once
+	// it has started.
+	const std::string& proxy_uri() const { return uri; }
+
+private:
+	void run();
+	std::string archive_path(const char *method, SoupURI *, const char *ext) const;
+	void record(SoupMessage *, SoupURI *);
+	void replay(SoupMessage *, SoupURI *);
+
+	static void on_request(SoupServer *, SoupMessage *, const char *, GHashTable *,
+		SoupClientContext *, gpointer);
+};
+
+} // namespace volo
+
+#endif // _VOLO_REPLAY_PROXY_H
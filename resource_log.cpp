@@ -0,0 +1,223 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#include <encoding.h>
+#include <resource_log.h>
+
+using namespace volo;
+
+// Quark of the sequence number set on each recorded resource, by which its
+// entry is found.
+static GQuark seq_quark() {
+	static const auto quark = g_quark_from_static_string("volo-resource-seq");
+	return quark;
+}
+
+// connect_resource connects a slot, typed as the handler of the signal, to a
+// signal of resource.
+template <class... Args>
+static void connect_resource(WebKitWebResource& resource, const char *signal,
+	void (*slot)(WebKitWebResource *, Args...), resource_log *log) {
+
+	g_signal_connect(&resource, signal, G_CALLBACK(slot), log);
+}
+
+// copy_field copies a possibly null string to a fixed size field, truncating
+// it if necessary.
+template <size_t N>
+static void copy_field(char (&field)[N], const char *s) {
+	g_strlcpy(field, s ? s : "", N);
+}
+
+resource_log::resource_log() : entries(capacity) {}
+
+resource_log::~resource_log() {
+	for (auto& e : entries) {
+		release(e);
+	}
+}
+
+void resource_log::release(entry& e) {
+	if (!e.resource) {
+		return;
+	}
+	g_signal_handlers_disconnect_by_data(e.resource, this);
+	g_object_unref(e.resource);
+	e.resource = nullptr;
+}
+
+void resource_log::resource_started(WebKitWebResource& resource, WebKitURIRequest& request,
+	bool main_resource) {
+
+	const auto seq = next_seq++;
+	auto& e = entries[seq % capacity];
+	release(e);
+	e.seq = seq;
+	e.started = g_get_monotonic_time();
+	e.responded = 0;
+	e.finished = 0;
+	e.size = 0;
+	e.status = 0;
+	e.failed = false;
+	auto method = webkit_uri_request_get_http_method(&request);
+	copy_field(e.method, method ? method : "GET");
+	copy_field(e.uri, webkit_uri_request_get_uri(&request));
+	copy_field(e.mime_type, nullptr);
+	if (main_resource) {
+		page_seq = seq;
+		page_started = e.started;
+	}
+
+	e.resource = static_cast<WebKitWebResource *>(g_object_ref(&resource));
+	g_object_set_qdata(G_OBJECT(&resource), seq_quark(), GSIZE_TO_POINTER(seq));
+	connect_resource(resource, "notify::response", on_response, this);
+	connect_resource(resource, "received-data", on_received_data, this);
+	connect_resource(resource, "finished", on_finished, this);
+	connect_resource(resource, "failed", on_failed, this);
+}
+
+// find returns the entry of a resource, or null if it has been dropped.
+resource_log::entry *resource_log::find(WebKitWebResource& resource) {
+	auto seq = GPOINTER_TO_SIZE(g_object_get_qdata(G_OBJECT(&resource), seq_quark()));
+	auto& e = entries[seq % capacity];
+	return seq && e.seq == seq && e.resource == &resource ? &e : nullptr;
+}
+
+void resource_log::on_response(WebKitWebResource& resource) {
+	auto e = find(resource);
+	auto response = webkit_web_resource_get_response(&resource);
+	if (!e || !response) {
+		return;
+	}
+	e->responded = g_get_monotonic_time();
+	e->status = webkit_uri_response_get_status_code(response);
+	copy_field(e->mime_type, webkit_uri_response_get_mime_type(response));
+}
+
+void resource_log::on_received_data(WebKitWebResource& resource, guint64 length) {
+	if (auto e = find(resource)) {
+		e->size += length;
+	}
+}
+
+void resource_log::on_finished(WebKitWebResource& resource, bool failed) {
+	auto e = find(resource);
+	if (!e) {
+		return;
+	}
+	if (!e->finished) {
+		e->finished = g_get_monotonic_time();
+	}
+	if (failed) {
+		// WebKit emits finished after failed, which releases it.
+		e->failed = true;
+		return;
+	}
+	release(*e);
+}
+
+// append_date appends a monotonic time as an ISO 8601 date in UTC.
+static void append_date(std::string& out, gint64 monotonic) {
+	const auto real = monotonic + (g_get_real_time() - g_get_monotonic_time());
+	const time_t secs = real / G_USEC_PER_SEC;
+	struct tm tm;
+	gmtime_r(&secs, &tm);
+	char date[32], buf[48];
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(buf, sizeof(buf), "\"%s.%03dZ\"", date,
+		static_cast<int>(real % G_USEC_PER_SEC / 1000));
+	out += buf;
+}
+
+// append_ms appends a duration in microseconds as milliseconds.
+static void append_ms(std::string& out, gint64 duration) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.3f", duration / 1000.0);
+	out += buf;
+}
+
+bool resource_log::write_har(const char *path, const char *title,
+	const load_timing& timing) const {
+
+	if (!page_seq) {
+		return false;
+	}
+	const auto now = g_get_monotonic_time();
+	const auto last = next_seq - 1;
+	const auto first_kept = last >= capacity ? last - capacity + 1 : 1;
+	const auto first = std::max(page_seq, first_kept);
+
+	auto out = std::string{"{\"log\":{\"version\":\"1.2\","
+		"\"creator\":{\"name\":\"volo\",\"version\":\"\"},"
+		"\"pages\":[{\"id\":\"page_1\",\"startedDateTime\":"};
+	append_date(out, page_started);
+	out += ",\"title\":";
+	append_json_string(out, title ? title : "");
+	out += ",\"pageTimings\":{\"onContentLoad\":-1,\"onLoad\":";
+	if (timing.started && timing.finished) {
+		append_ms(out, timing.finished - timing.started);
+	} else {
+		out += "-1";
+	}
+	out += '}';
+	if (first > page_seq) {
+		out += ",\"comment\":\"";
+		out += std::to_string(first - page_seq);
+		out += " earlier resources were not recorded\"";
+	}
+	out += "}],\"entries\":[";
+
+	for (auto seq = first; seq <= last; ++seq) {
+		auto& e = entries[seq % capacity];
+		const auto end = e.finished ? e.finished : now;
+		const auto wait = (e.responded ? e.responded : end) - e.started;
+		const auto receive = e.responded ? end - e.responded : 0;
+
+		if (seq != first) {
+			out += ',';
+		}
+		out += "{\"pageref\":\"page_1\",\"startedDateTime\":";
+		append_date(out, e.started);
+		out += ",\"time\":";
+		append_ms(out, wait + receive);
+		out += ",\"request\":{\"method\":";
+		append_json_string(out, e.method);
+		out += ",\"url\":";
+		append_json_string(out, e.uri);
+		out += ",\"httpVersion\":\"\",\"cookies\":[],\"headers\":[],\"queryString\":[],"
+			"\"headersSize\":-1,\"bodySize\":-1},\"response\":{\"status\":";
+		out += std::to_string(e.status);
+		out += ",\"statusText\":\"\",\"httpVersion\":\"\",\"cookies\":[],\"headers\":[],"
+			"\"content\":{\"size\":";
+		out += std::to_string(e.size);
+		out += ",\"mimeType\":";
+		append_json_string(out, e.mime_type);
+		out += "},\"redirectURL\":\"\",\"headersSize\":-1,\"bodySize\":";
+		out += std::to_string(e.size);
+		out += "},\"cache\":{},\"timings\":{\"send\":0,\"wait\":";
+		append_ms(out, wait);
+		out += ",\"receive\":";
+		append_ms(out, receive);
+		out += '}';
+		if (e.failed) {
+			out += ",\"_failed\":true";
+		} else if (!e.finished) {
+			out += ",\"_pending\":true";
+		}
+		out += '}';
+	}
+	out += "]}}\n";
+
+	GError *error = nullptr;
+	if (!g_file_set_contents(path, out.data(), out.size(), &error)) {
+		g_warning("volo: writing %s: %s", path, error->message);
+		g_error_free(error);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_RESOURCE_LOG_H
+#define _VOLO_RESOURCE_LOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <webkit.h>
+#include <load_stats.h>
+#include <stall_monitor.h>
+
+namespace volo {
+
+// resource_log records the network timing of every resource loaded by a
+// web_view, from the start of its load until it finishes or fails, along
+// with its status, MIME type and size.  The resources of the page currently
+// loaded may be exported as a HAR file.
+//
+// Resources are recorded in a ring buffer allocated once, so recording
+// allocates nothing for each resource, and URIs longer than max_uri_length
+// are truncated.  Once the ring is full, the oldest resources are dropped.
+// WebKit does not expose DNS, connection or TLS timing, so only the wait for
+// the response and the time to receive the body are recorded.
+class resource_log {
+public:
+	static const size_t capacity = 256;
+	static const size_t max_uri_length = 512;
+
+	struct entry {
+		// Sequence number of the resource, starting at one, or zero if
+		// the entry is unused.
+		uint64_t seq{0};
+		// The resource, referenced until it finishes or fails.
+		WebKitWebResource *resource{nullptr};
+		// Monotonic times, in microseconds, or zero when not reached.
+		gint64 started{0};
+		gint64 responded{0};
+		gint64 finished{0};
+		uint64_t size{0};
+		unsigned int status{0};
+		bool failed{false};
+		char method[8];
+		char mime_type[64];
+		char uri[max_uri_length];
+	};
+
+private:
+	std::vector<entry> entries;
+	uint64_t next_seq{1};
+	// Sequence number of the main resource of the current page.
+	uint64_t page_seq{0};
+	gint64 page_started{0};
+
+public:
+	resource_log();
+	~resource_log();
+
+	resource_log(const resource_log&) = delete;
+	resource_log& operator=(const resource_log&) = delete;
+
+	// resource_started begins recording a resource loaded for request.
+	// The main resource of a page begins a new page, and the resources
+	// of the previous page are no longer exported.
+	void resource_started(WebKitWebResource&, WebKitURIRequest&, bool main_resource);
+
+	// write_har writes the resources of the current page to path as an
+	// HTTP Archive, with the page's title and load timing.  Resources
+	// still loading are included with the time they have taken so far.
+	// It returns false if the file could not be written.
+	bool write_har(const char *path, const char *title, const load_timing&) const;
+
+private:
+	entry *find(WebKitWebResource&);
+	void release(entry&);
+
+	void on_response(WebKitWebResource&);
+	void on_received_data(WebKitWebResource&, guint64);
+	void on_finished(WebKitWebResource&, bool failed);
+
+	static void on_response(WebKitWebResource *r, GParamSpec *, gpointer log) {
+		slot_timer t{"resource_log::on_response"};
+		static_cast<resource_log *>(log)->on_response(*r);
+	}
+	static void on_received_data(WebKitWebResource *r, guint64 length, gpointer log) {
+		slot_timer t{"resource_log::on_received_data"};
+		static_cast<resource_log *>(log)->on_received_data(*r, length);
+	}
+	static void on_finished(WebKitWebResource *r, gpointer log) {
+		slot_timer t{"resource_log::on_finished"};
+		static_cast<resource_log *>(log)->on_finished(*r, false);
+	}
+	static void on_failed(WebKitWebResource *r, GError *, gpointer log) {
+		slot_timer t{"resource_log::on_failed"};
+		static_cast<resource_log *>(log)->on_finished(*r, true);
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_RESOURCE_LOG_H
@@ -0,0 +1,287 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <encoding.h>
+#include <gtk.h>
+#include <session.h>
+
+using namespace volo;
+
+// The journal begins with an 8 byte magic string and a version number.
+// Each record that follows has the layout
+//
+//	u32 payload length
+//	u32 CRC-32 of the payload
+//	u8  record type
+//	u32 tab id
+//	u32 argument (the notebook index for open and move records)
+//	    URI (open and uri records), filling the rest of the payload
+//
+// Integers are stored in host byte order, as the journal is never shared
+// between machines.
+static const char journal_magic[8] = {'v', 'o', 'l', 'o', 's', 'e', 's', 's'};
+const uint32_t journal_version = 1;
+const size_t header_size = sizeof(journal_magic) + 4;
+const size_t record_header_size = 8;
+const size_t payload_fixed_size = 9;
+
+// Interval, in milliseconds, between writes (and syncs) of buffered records.
+const unsigned int flush_interval = 1000;
+
+static uint32_t crc32(const unsigned char *p, size_t n) {
+	static const auto table = [] {
+		std::array<uint32_t, 256> t;
+		for (uint32_t i = 0; i < 256; ++i) {
+			auto c = i;
+			for (int k = 0; k < 8; ++k) {
+				c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			}
+			t[i] = c;
+		}
+		return t;
+	}();
+
+	uint32_t c = 0xffffffff;
+	while (n--) {
+		c = table[(c ^ *p++) & 0xff] ^ (c >> 8);
+	}
+	return c ^ 0xffffffff;
+}
+
+// encode_record appends a complete record to buf.
+static void encode_record(std::string& buf, session_journal::record_type type,
+	uint32_t id, uint32_t arg, const char *uri) {
+
+	auto uri_len = strlen(uri);
+	auto start = buf.size();
+	put_u32(buf, payload_fixed_size + uri_len);
+	put_u32(buf, 0);
+	buf.push_back(type);
+	put_u32(buf, id);
+	put_u32(buf, arg);
+	buf.append(uri, uri_len);
+
+	auto payload = reinterpret_cast<const unsigned char *>(buf.data()) + start + record_header_size;
+	auto crc = crc32(payload, payload_fixed_size + uri_len);
+	memcpy(&buf[start + 4], &crc, sizeof(crc));
+}
+
+session_journal::~session_journal() {
+	if (flush_source) {
+		g_source_remove(flush_source);
+	}
+	if (fd != -1) {
+		flush();
+		close(fd);
+	}
+	if (lock_fd != -1) {
+		close(lock_fd);
+	}
+}
+
+bool session_journal::open() {
+	auto dir = g_build_filename(g_get_user_data_dir(), "volo", nullptr);
+	g_mkdir_with_parents(dir, 0700);
+	auto session_path = g_build_filename(dir, "session", nullptr);
+	auto lock_path = g_build_filename(dir, "session.lock", nullptr);
+	path = session_path;
+	g_free(dir);
+	g_free(session_path);
+
+	// The journal itself is replaced during compaction, so a separate
+	// file is locked to keep other browser processes from using it.
+	lock_fd = ::open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	g_free(lock_path);
+	if (lock_fd == -1 || flock(lock_fd, LOCK_EX | LOCK_NB) == -1) {
+		return false;
+	}
+
+	auto old_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	auto replayed = true;
+	struct stat st;
+	if (old_fd != -1 && fstat(old_fd, &st) == 0 && st.st_size > 0) {
+		auto size = static_cast<size_t>(st.st_size);
+		auto base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, old_fd, 0);
+		if (base != MAP_FAILED) {
+			madvise(base, size, MADV_SEQUENTIAL);
+			replayed = replay(static_cast<const unsigned char *>(base), size);
+			munmap(base, size);
+		} else {
+			replayed = false;
+		}
+	}
+	if (old_fd != -1) {
+		close(old_fd);
+	}
+
+	// Compaction replaces the journal, so a journal which could not be
+	// replayed (perhaps written by another version) is moved aside
+	// rather than lost.
+	if (!replayed) {
+		auto aside = path + ".unrecognized";
+		g_warning("volo: moving unrecognized session journal %s to %s",
+			path.c_str(), aside.c_str());
+		if (rename(path.c_str(), aside.c_str()) == -1) {
+			g_warning("volo: %s: %s", aside.c_str(), g_strerror(errno));
+			return false;
+		}
+	}
+
+	return compact();
+}
+
+// replay restores the tabs recorded in a mapped journal, returning false if
+// its header is not recognized.
+bool session_journal::replay(const unsigned char *p, size_t size) {
+	if (size < header_size || memcmp(p, journal_magic, sizeof(journal_magic)) ||
+		get_u32(p + sizeof(journal_magic)) != journal_version) {
+
+		return false;
+	}
+
+	// URIs reference the mapped journal until the replay completes.
+	struct uri_ref {
+		const char *p;
+		size_t len;
+	};
+	std::unordered_map<uint32_t, uri_ref> uris;
+	std::vector<uint32_t> order;
+
+	auto off = header_size;
+	while (size - off >= record_header_size) {
+		auto len = get_u32(p + off);
+		auto crc = get_u32(p + off + 4);
+		if (len < payload_fixed_size || len > size - off - record_header_size) {
+			break;
+		}
+		auto payload = p + off + record_header_size;
+		if (crc32(payload, len) != crc) {
+			break;
+		}
+		off += record_header_size + len;
+
+		auto id = get_u32(payload + 1);
+		auto arg = get_u32(payload + 5);
+		auto uri = uri_ref{reinterpret_cast<const char *>(payload + payload_fixed_size),
+			len - payload_fixed_size};
+		auto it = uris.find(id);
+		switch (payload[0]) {
+		case record_open:
+			if (it == uris.end()) {
+				uris.emplace(id, uri);
+				auto index = std::min<size_t>(arg, order.size());
+				order.insert(order.begin() + index, id);
+			}
+			break;
+		case record_close:
+			if (it != uris.end()) {
+				uris.erase(it);
+				order.erase(std::find(order.begin(), order.end(), id));
+			}
+			break;
+		case record_move:
+			if (it != uris.end()) {
+				order.erase(std::find(order.begin(), order.end(), id));
+				auto index = std::min<size_t>(arg, order.size());
+				order.insert(order.begin() + index, id);
+			}
+			break;
+		case record_uri:
+			if (it != uris.end()) {
+				it->second = uri;
+			}
+			break;
+		}
+	}
+	if (off != size) {
+		g_warning("volo: session journal truncated after %zu bytes", off);
+	}
+
+	restored.reserve(order.size());
+	uint32_t id = 0;
+	for (auto tab : order) {
+		auto& uri = uris[tab];
+		restored.push_back(session_tab{++id, std::string(uri.p, uri.len)});
+	}
+	return true;
+}
+
+bool session_journal::compact() {
+	auto data = std::string{journal_magic, sizeof(journal_magic)};
+	put_u32(data, journal_version);
+	for (size_t i = 0; i < restored.size(); ++i) {
+		auto& tab = restored[i];
+		encode_record(data, record_open, tab.id, i, tab.uri.c_str());
+	}
+	next_id = restored.size() + 1;
+
+	// Write the compacted journal beside the old one and atomically
+	// replace it, so that a crash leaves one or the other intact.
+	auto tmp_path = path + ".tmp";
+	auto tmp_fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (tmp_fd == -1) {
+		g_warning("volo: %s: %s", tmp_path.c_str(), g_strerror(errno));
+		return false;
+	}
+	if (!write_all(tmp_fd, data) || fdatasync(tmp_fd) == -1 ||
+		rename(tmp_path.c_str(), path.c_str()) == -1) {
+
+		g_warning("volo: compacting session journal: %s", g_strerror(errno));
+		close(tmp_fd);
+		unlink(tmp_path.c_str());
+		return false;
+	}
+	close(tmp_fd);
+
+	fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+	return fd != -1;
+}
+
+uint32_t session_journal::tab_opened(uint32_t index, const char *uri) {
+	auto id = next_id++;
+	append(record_open, id, index, uri);
+	return id;
+}
+
+void session_journal::tab_closed(uint32_t id) {
+	append(record_close, id, 0);
+}
+
+void session_journal::tab_moved(uint32_t id, uint32_t index) {
+	append(record_move, id, index);
+}
+
+void session_journal::uri_changed(uint32_t id, const char *uri) {
+	append(record_uri, id, 0, uri);
+}
+
+void session_journal::append(record_type type, uint32_t id, uint32_t arg, const char *uri) {
+	encode_record(buf, type, id, arg, uri);
+	if (!flush_source) {
+		flush_source = gtk::timeout_add(flush_interval, *this, on_flush_timeout);
+	}
+}
+
+void session_journal::flush() {
+	if (buf.empty() || fd == -1) {
+		return;
+	}
+	if (!write_all(fd, buf) || fdatasync(fd) == -1) {
+		g_warning("volo: writing session journal: %s", g_strerror(errno));
+	}
+	buf.clear();
+}
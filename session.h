@@ -0,0 +1,97 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_SESSION_H
+#define _VOLO_SESSION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include <stall_monitor.h>
+
+namespace volo {
+
+// session_tab describes a tab restored from the session journal.
+struct session_tab {
+	uint32_t id;
+	std::string uri;
+};
+
+// session_journal records changes to the browser's tabs in an append-only
+// binary log, so that the session survives the browser exiting or
+// crashing.  Each record is checksummed; a torn record at the end of the
+// log (from a crash mid-write) and everything after it is ignored.
+//
+// Records are buffered and written, followed by a single fdatasync, at
+// most once per flush interval.  On open, the existing log is mapped into
+// memory and replayed, and a compacted log containing only an open record
+// for each remaining tab replaces it.
+//
+// Tabs are identified by ids which are unique within the journal.  Ids of
+// restored tabs are renumbered during compaction.
+class session_journal {
+private:
+	std::string path;
+	int fd{-1};
+	int lock_fd{-1};
+	uint32_t next_id{1};
+	std::vector<session_tab> restored;
+	std::string buf;
+	unsigned int flush_source{0};
+
+public:
+	enum record_type : uint8_t {
+		record_open = 1,
+		record_close,
+		record_move,
+		record_uri,
+	};
+
+	session_journal() {}
+	~session_journal();
+
+	session_journal(const session_journal&) = delete;
+	session_journal& operator=(const session_journal&) = delete;
+
+	// open replays and compacts the journal in the user's data
+	// directory and prepares it for appending.  It returns false if the
+	// journal cannot be used (for example, when another browser process
+	// holds it), in which case the session is not saved.  A journal which
+	// cannot be replayed is moved aside to session.unrecognized.
+	bool open();
+
+	// restored_tabs returns the tabs of the previous session, in
+	// notebook order.  clear_restored frees them once opened.
+	const std::vector<session_tab>& restored_tabs() const { return restored; }
+	void clear_restored() { std::vector<session_tab>{}.swap(restored); }
+
+	// Record changes to the browser's tabs.  tab_opened returns the id
+	// assigned to the new tab.
+	uint32_t tab_opened(uint32_t index, const char *uri);
+	void tab_closed(uint32_t id);
+	void tab_moved(uint32_t id, uint32_t index);
+	void uri_changed(uint32_t id, const char *uri);
+
+	// flush writes and syncs any buffered records.
+	void flush();
+
+private:
+	void append(record_type, uint32_t id, uint32_t arg, const char *uri = "");
+	bool replay(const unsigned char *, size_t);
+	bool compact();
+
+	static gboolean on_flush_timeout(session_journal *j) {
+		slot_timer t{"session_journal::on_flush_timeout"};
+		j->flush_source = 0;
+		j->flush();
+		return G_SOURCE_REMOVE;
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_SESSION_H
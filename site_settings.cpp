@@ -0,0 +1,224 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include <glib.h>
+
+#include <encoding.h>
+#include <site_settings.h>
+#include <uri.h>
+
+using namespace volo;
+
+bool site_settings::rule::operator==(const rule& r) const {
+	return javascript == r.javascript && images == r.images &&
+		autoplay == r.autoplay && user_agent == r.user_agent;
+}
+
+void site_settings::load() {
+	auto path = g_build_filename(g_get_user_config_dir(), "volo", "sites", nullptr);
+	gchar *contents;
+	gsize len;
+	GError *error = nullptr;
+	if (!g_file_get_contents(path, &contents, &len, &error)) {
+		if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+			g_warning("volo: %s", error->message);
+		}
+		g_error_free(error);
+		g_free(path);
+		return;
+	}
+
+	// A site named by more than one line takes the settings of each.
+	std::map<std::string, rule> rules;
+	auto text = std::string{contents, len};
+	g_free(contents);
+	unsigned int line_number = 0;
+	for (size_t pos = 0; pos < text.size();) {
+		auto end = text.find('\n', pos);
+		if (end == std::string::npos) {
+			end = text.size();
+		}
+		auto line = text.substr(pos, end - pos);
+		pos = end + 1;
+		++line_number;
+
+		std::string domain;
+		rule r;
+		if (!parse_line(path, line_number, line, domain, r)) {
+			continue;
+		}
+		auto& merged = rules[domain];
+		if (r.javascript != toggle::unset) {
+			merged.javascript = r.javascript;
+		}
+		if (r.images != toggle::unset) {
+			merged.images = r.images;
+		}
+		if (r.autoplay != toggle::unset) {
+			merged.autoplay = r.autoplay;
+		}
+		if (!r.user_agent.empty()) {
+			merged.user_agent = std::move(r.user_agent);
+		}
+	}
+	g_free(path);
+	build(rules);
+}
+
+// parse_line parses a line of the sites file into the registrable domain it
+// names and its rule, returning false for blank lines and comments.  Settings
+// which are not understood are skipped with a warning.
+bool site_settings::parse_line(const char *path, unsigned int line_number,
+	const std::string& line, std::string& domain, rule& r) {
+
+	static const char *const space = " \t\r";
+	auto pos = line.find_first_not_of(space);
+	if (pos == std::string::npos || line[pos] == '#') {
+		return false;
+	}
+	auto end = std::min(line.find_first_of(space, pos), line.size());
+	domain = line.substr(pos, end - pos);
+	std::transform(domain.begin(), domain.end(), domain.begin(), ::tolower);
+	if (domain.back() == '.') {
+		domain.pop_back();
+	}
+	domain.erase(0, registrable_domain(domain.data(), domain.size()));
+	if (domain.empty()) {
+		g_warning("volo: %s:%u: missing site", path, line_number);
+		return false;
+	}
+
+	for (pos = line.find_first_not_of(space, end); pos != std::string::npos;
+		pos = line.find_first_not_of(space, end)) {
+
+		end = std::min(line.find_first_of(space, pos), line.size());
+		auto field = line.substr(pos, end - pos);
+		auto eq = field.find('=');
+		auto name = field.substr(0, eq);
+		if (eq != std::string::npos && name == "user-agent") {
+			// The user agent is the rest of the line, spaces and all.
+			end = line.find_last_not_of(space) + 1;
+			r.user_agent = line.substr(pos + eq + 1, end - pos - eq - 1);
+			break;
+		}
+
+		auto value = eq != std::string::npos ? field.substr(eq + 1) : std::string{};
+		auto t = value == "on" ? toggle::on : value == "off" ? toggle::off : toggle::unset;
+		if (t != toggle::unset && name == "javascript") {
+			r.javascript = t;
+		} else if (t != toggle::unset && name == "images") {
+			r.images = t;
+		} else if (t != toggle::unset && name == "autoplay") {
+			r.autoplay = t;
+		} else {
+			g_warning("volo: %s:%u: ignoring unrecognized setting %s",
+				path, line_number, field.c_str());
+		}
+	}
+	return true;
+}
+
+// build creates the settings of each distinct rule, and the table of sites.
+void site_settings::build(const std::map<std::string, rule>& rules) {
+	table.clear();
+	sites.clear();
+	names.clear();
+	profiles.clear();
+	if (rules.empty()) {
+		return;
+	}
+
+	std::vector<const rule *> distinct;
+	for (auto& r : rules) {
+		auto it = std::find_if(distinct.begin(), distinct.end(),
+			[&r](const rule *d) { return *d == r.second; });
+		if (it == distinct.end()) {
+			distinct.push_back(&r.second);
+			profiles.push_back(create_profile(r.second));
+			it = distinct.end() - 1;
+		}
+		auto s = site{};
+		s.name_offset = names.size();
+		s.name_length = r.first.size();
+		s.profile = it - distinct.begin();
+		sites.push_back(s);
+		names += r.first;
+	}
+
+	// The table is kept at most half full, so that probes stay short.
+	size_t table_size = 1;
+	while (table_size < 2 * sites.size()) {
+		table_size <<= 1;
+	}
+	table.assign(table_size, slot{0, 0});
+	const auto mask = table_size - 1;
+	for (size_t n = 0; n < sites.size(); ++n) {
+		auto h = hash(names.data() + sites[n].name_offset, sites[n].name_length);
+		auto i = h & mask;
+		while (table[i].site) {
+			i = (i + 1) & mask;
+		}
+		table[i] = slot{h, uint32_t(n + 1)};
+	}
+}
+
+site_settings::settings_ptr site_settings::create_profile(const rule& r) {
+	auto settings = settings_ptr{webkit::settings::create()};
+	if (r.javascript != toggle::unset) {
+		settings->set_enable_javascript_markup(r.javascript == toggle::on);
+	}
+	if (r.images != toggle::unset) {
+		settings->set_auto_load_images(r.images == toggle::on);
+	}
+	if (r.autoplay != toggle::unset) {
+		settings->set_media_playback_requires_user_gesture(r.autoplay == toggle::off);
+	}
+	if (!r.user_agent.empty()) {
+		settings->set_user_agent(r.user_agent.c_str());
+	}
+	return settings;
+}
+
+// hash is the FNV-1a hash of a domain, ignoring case, truncated to the
+// width kept in the table.
+uint32_t site_settings::hash(const char *name, size_t len) {
+	auto h = fnv1a_basis;
+	for (size_t n = 0; n < len; ++n) {
+		h = fnv1a_add(h, g_ascii_tolower(name[n]));
+	}
+	return uint32_t(h);
+}
+
+webkit::settings *site_settings::find(const char *uri) const {
+	const char *host;
+	size_t len;
+	if (table.empty() || !uri_host_span(uri, host, len)) {
+		return nullptr;
+	}
+	if (host[len - 1] == '.') {
+		--len;
+	}
+	const auto offset = registrable_domain(host, len);
+	host += offset;
+	len -= offset;
+
+	const auto h = hash(host, len);
+	const auto mask = table.size() - 1;
+	for (auto i = h & mask; table[i].site; i = (i + 1) & mask) {
+		if (table[i].hash != h) {
+			continue;
+		}
+		auto& s = sites[table[i].site - 1];
+		if (s.name_length == len &&
+			!g_ascii_strncasecmp(names.data() + s.name_offset, host, len)) {
+
+			return profiles[s.profile].get();
+		}
+	}
+	return nullptr;
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_SITE_SETTINGS_H
+#define _VOLO_SITE_SETTINGS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtk.h>
+#include <webkit.h>
+
+namespace volo {
+
+// site_settings overrides the settings of pages from particular sites.  Rules
+// are read at startup from the sites file of volo's configuration directory,
+// one site per line:
+//
+//	# Comments begin with '#'.
+//	example.com javascript=off images=off
+//	video.example.org autoplay=on
+//	old.example.net user-agent=Mozilla/5.0 (compatible)
+//
+// javascript, images and autoplay may be on or off, and user-agent takes the
+// rest of the line.  javascript only concerns the scripts of pages; those
+// volo runs itself are unaffected.  A rule applies to every host of its registrable domain
+// (so the first rule above also applies to www.example.com), and settings it
+// does not mention keep WebKit's defaults.  A tab's settings are chosen as
+// each navigation of its main frame (or redirect) is decided, before the
+// request is sent.
+//
+// Each distinct rule is given its own WebKit settings, created as the rules
+// are loaded and shared by the web_views of every site it applies to.  Sites
+// are found by a hash of their registrable domain in an open addressing
+// table, so finding the settings for a navigation neither allocates nor
+// depends on the number of rules.
+class site_settings {
+private:
+	enum class toggle : uint8_t {
+		unset,
+		on,
+		off,
+	};
+	struct rule {
+		toggle javascript{toggle::unset};
+		toggle images{toggle::unset};
+		toggle autoplay{toggle::unset};
+		std::string user_agent;
+
+		bool operator==(const rule&) const;
+	};
+	// site is a registrable domain, stored in names, and the index of
+	// the settings of its rule.
+	struct site {
+		uint32_t name_offset;
+		uint32_t name_length;
+		uint32_t profile;
+	};
+	// slot is an entry of the hash table: a domain's hash and one plus
+	// the index of its site, or zero if the slot is empty.
+	struct slot {
+		uint32_t hash;
+		uint32_t site;
+	};
+	using settings_ptr = gtk::unique_ptr<webkit::settings,
+		gtk::unref_delete<webkit::settings>>;
+
+	std::vector<slot> table;
+	std::vector<site> sites;
+	std::string names;
+	std::vector<settings_ptr> profiles;
+
+public:
+	// load reads the rules of the sites file, if there is one.
+	void load();
+
+	// find returns the settings for the site of uri, or null if no rule
+	// applies to it.
+	webkit::settings *find(const char *uri) const;
+
+	size_t size() const { return sites.size(); }
+
+private:
+	void build(const std::map<std::string, rule>&);
+	static bool parse_line(const char *path, unsigned int line_number,
+		const std::string& line, std::string& domain, rule&);
+	static settings_ptr create_profile(const rule&);
+	static uint32_t hash(const char *name, size_t len);
+};
+
+} // namespace volo
+
+#endif // _VOLO_SITE_SETTINGS_H
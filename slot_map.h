@@ -0,0 +1,136 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_SLOT_MAP_H
+#define _VOLO_SLOT_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace volo {
+
+// slot_handle refers to a value of a slot_map.  A handle remains valid until
+// its value is erased and is never valid again afterwards, even once its slot
+// is reused, since each handle records the generation of its slot.  The
+// default handle refers to no value.
+struct slot_handle {
+	uint32_t index{0};
+	uint32_t generation{0};
+
+	explicit operator bool() const { return generation != 0; }
+
+	bool operator==(const slot_handle& h) const {
+		return index == h.index && generation == h.generation;
+	}
+	bool operator!=(const slot_handle& h) const { return !(*this == h); }
+};
+
+// slot_map stores values referred to by slot_handles.  Inserting, finding and
+// erasing a value take constant time.  Values are kept contiguous, in no
+// particular order, for iteration.  Erasing a value moves the last value into
+// its place, so pointers and references to values are only valid until the
+// next insertion or erasure, while handles remain valid.
+template <typename T>
+class slot_map {
+private:
+	static const uint32_t no_slot = UINT32_MAX;
+
+	struct slot {
+		// Position of the slot's value, or when the slot is free, the
+		// index of the next free slot.
+		uint32_t position;
+		// Incremented both when a value is inserted and erased, so the
+		// generation of a slot in use is always odd.
+		uint32_t generation;
+	};
+
+	std::vector<T> values;
+	// Index of the slot of each value.
+	std::vector<uint32_t> value_slots;
+	std::vector<slot> slots;
+	uint32_t free_slot{no_slot};
+
+public:
+	using iterator = typename std::vector<T>::iterator;
+	using const_iterator = typename std::vector<T>::const_iterator;
+
+	// emplace inserts a value constructed from args, returning its handle.
+	template <typename... Args>
+	slot_handle emplace(Args&&... args) {
+		uint32_t index;
+		if (free_slot != no_slot) {
+			index = free_slot;
+			free_slot = slots[index].position;
+		} else {
+			index = slots.size();
+			slots.push_back(slot{0, 0});
+		}
+		values.emplace_back(std::forward<Args>(args)...);
+		value_slots.push_back(index);
+		auto& s = slots[index];
+		s.position = values.size() - 1;
+		++s.generation;
+		return slot_handle{index, s.generation};
+	}
+
+	// contains returns whether the handle refers to a value in the map.
+	bool contains(slot_handle h) const {
+		return h.index < slots.size() && slots[h.index].generation == h.generation &&
+			(h.generation & 1);
+	}
+
+	// get returns the value of a handle, or null if it is not valid.
+	T *get(slot_handle h) {
+		return contains(h) ? &values[slots[h.index].position] : nullptr;
+	}
+	const T *get(slot_handle h) const {
+		return contains(h) ? &values[slots[h.index].position] : nullptr;
+	}
+
+	// take erases the value of a valid handle, returning it.
+	T take(slot_handle h) {
+		auto& s = slots[h.index];
+		const auto position = s.position;
+		T value = std::move(values[position]);
+		if (position != values.size() - 1) {
+			values[position] = std::move(values.back());
+			value_slots[position] = value_slots.back();
+			slots[value_slots[position]].position = position;
+		}
+		values.pop_back();
+		value_slots.pop_back();
+
+		++s.generation;
+		s.position = free_slot;
+		free_slot = h.index;
+		return value;
+	}
+
+	// erase destroys the value of a handle, if it is valid.
+	void erase(slot_handle h) {
+		if (contains(h)) {
+			take(h);
+		}
+	}
+
+	void reserve(size_t n) {
+		values.reserve(n);
+		value_slots.reserve(n);
+		slots.reserve(n);
+	}
+
+	size_t size() const { return values.size(); }
+	bool empty() const { return values.empty(); }
+
+	iterator begin() { return values.begin(); }
+	iterator end() { return values.end(); }
+	const_iterator begin() const { return values.begin(); }
+	const_iterator end() const { return values.end(); }
+};
+
+} // namespace volo
+
+#endif // _VOLO_SLOT_MAP_H
@@ -0,0 +1,103 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+// slot_map_test checks that slot_map handles stay valid until their values
+// are erased, and are never valid again once their slots are reused.
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include <slot_map.h>
+
+using namespace volo;
+
+static unsigned int failures = 0;
+
+static void check(bool ok, const char *what, int line) {
+	if (!ok) {
+		fprintf(stderr, "slot_map_test:%d: %s\n", line, what);
+		++failures;
+	}
+}
+
+#define CHECK(x) check((x), #x, __LINE__)
+
+int main() {
+	slot_map<std::string> m;
+
+	CHECK(!slot_handle{});
+	CHECK(!m.contains(slot_handle{}));
+	CHECK(!m.get(slot_handle{}));
+
+	auto a = m.emplace("a");
+	auto b = m.emplace("b");
+	auto c = m.emplace("c");
+	CHECK(a && b && c);
+	CHECK(m.size() == 3);
+	CHECK(*m.get(a) == "a" && *m.get(b) == "b" && *m.get(c) == "c");
+
+	// Taking a value moves the last value into its place, which must
+	// remain reachable through its own handle.
+	CHECK(m.take(a) == "a");
+	CHECK(m.size() == 2);
+	CHECK(!m.contains(a) && !m.get(a));
+	CHECK(*m.get(b) == "b" && *m.get(c) == "c");
+
+	// The freed slot is reused with a new generation, so the stale
+	// handle does not refer to the new value.
+	auto d = m.emplace("d");
+	CHECK(d.index == a.index && d.generation != a.generation);
+	CHECK(d != a);
+	CHECK(!m.contains(a) && !m.get(a));
+	CHECK(*m.get(d) == "d");
+
+	// Erasing a stale handle leaves the value now in its slot.
+	m.erase(a);
+	CHECK(m.size() == 3);
+	CHECK(*m.get(d) == "d");
+
+	// Erasing twice is harmless.
+	m.erase(c);
+	m.erase(c);
+	CHECK(m.size() == 2);
+	CHECK(!m.get(c));
+	CHECK(*m.get(b) == "b" && *m.get(d) == "d");
+
+	// Reusing a slot many times never revives any earlier handle.
+	auto stale = d;
+	for (int n = 0; n < 1000; ++n) {
+		m.erase(stale);
+		auto h = m.emplace(std::to_string(n));
+		CHECK(h.index == stale.index);
+		CHECK(!m.contains(stale) && !m.get(stale));
+		CHECK(*m.get(h) == std::to_string(n));
+		stale = h;
+	}
+	CHECK(m.size() == 2);
+	CHECK(*m.get(b) == "b");
+
+	// Iteration visits every value once.
+	std::string all;
+	for (auto& v : m) {
+		all += v;
+	}
+	CHECK(all.size() == 1 + 3);
+
+	// Values need only be movable.
+	slot_map<std::unique_ptr<int>> p;
+	auto x = p.emplace(new int{1});
+	auto y = p.emplace(new int{2});
+	CHECK(*p.take(x) == 1);
+	CHECK(**p.get(y) == 2);
+	p.erase(x);
+	CHECK(p.size() == 1);
+
+	if (failures) {
+		fprintf(stderr, "slot_map_test: %u failures\n", failures);
+		return 1;
+	}
+	printf("slot_map_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,335 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+
+#include <glib/gstdio.h>
+
+#include <snapshot_cache.h>
+
+using namespace volo;
+
+// snapshot_request identifies the tab of a snapshot being taken.
+struct snapshot_request {
+	snapshot_cache *cache;
+	uint64_t key;
+};
+
+static size_t surface_size(cairo_surface_t *surface) {
+	return size_t(cairo_image_surface_get_stride(surface)) *
+		cairo_image_surface_get_height(surface);
+}
+
+// downscale returns a thumbnail of the top of a page's snapshot, scaled to
+// the thumbnail width.
+static cairo_surface_t *downscale(cairo_surface_t *snapshot) {
+	const auto width = cairo_image_surface_get_width(snapshot);
+	const auto height = cairo_image_surface_get_height(snapshot);
+	const auto scale = width > 0 ? double(snapshot_cache::thumbnail_width) / width : 1.0;
+	const auto thumbnail_height = std::max(1, std::min(snapshot_cache::thumbnail_height,
+		int(height * scale)));
+
+	auto thumbnail = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+		snapshot_cache::thumbnail_width, thumbnail_height);
+	auto cr = cairo_create(thumbnail);
+	cairo_scale(cr, scale, scale);
+	cairo_set_source_surface(cr, snapshot, 0, 0);
+	cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+	cairo_surface_flush(thumbnail);
+	return thumbnail;
+}
+
+snapshot_cache::snapshot_cache(const snapshot_policy& policy) : policy{policy} {
+	// The spill directory may be shared with other instances, or hold
+	// the user's own files, so thumbnails go in a directory of their own.
+	const auto& parent = policy.spill_directory;
+	if (!parent.empty()) {
+		auto tmpl = parent + "/volo-snapshots-XXXXXX";
+		if (g_mkdir_with_parents(parent.c_str(), 0700) == 0 &&
+			g_mkdtemp_full(&tmpl[0], 0700)) {
+
+			spill_directory = tmpl;
+		} else {
+			g_warning("volo: unable to create a snapshot directory in %s: %s",
+				parent.c_str(), g_strerror(errno));
+		}
+	}
+	thread = std::thread{&snapshot_cache::run, this};
+}
+
+snapshot_cache::~snapshot_cache() {
+	{
+		std::lock_guard<std::mutex> lock{mu};
+		stopping = true;
+	}
+	cv.notify_one();
+	thread.join();
+
+	if (results_source) {
+		g_source_remove(results_source);
+	}
+	for (auto& r : results) {
+		if (r.surface) {
+			cairo_surface_destroy(r.surface);
+		}
+	}
+	for (auto& e : entries) {
+		if (e.second.surface) {
+			cairo_surface_destroy(e.second.surface);
+		}
+	}
+	remove_spill_directory();
+}
+
+void snapshot_cache::set_changed(std::function<void()> f) {
+	changed = std::move(f);
+}
+
+std::string snapshot_cache::spill_path(uint64_t key) const {
+	char name[32];
+	snprintf(name, sizeof(name), "%016" PRIx64 ".png", key);
+	return spill_directory + '/' + name;
+}
+
+// remove_spill_directory removes the thumbnails this process wrote, and the
+// directory it created for them, once the background thread has stopped.
+void snapshot_cache::remove_spill_directory() {
+	if (spill_directory.empty()) {
+		return;
+	}
+	for (auto key : spilled_files) {
+		g_unlink(spill_path(key).c_str());
+	}
+	spilled_files.clear();
+	if (g_rmdir(spill_directory.c_str()) == -1) {
+		g_warning("volo: unable to remove %s: %s", spill_directory.c_str(),
+			g_strerror(errno));
+	}
+}
+
+void snapshot_cache::capture(uint64_t key, webkit::web_view& wv) {
+	++capturing[key];
+	wv.get_snapshot(on_snapshot, new snapshot_request{this, key});
+}
+
+void snapshot_cache::on_snapshot(GObject *wv, GAsyncResult *result, gpointer data) {
+	slot_timer t{"snapshot_cache::on_snapshot"};
+	auto request = static_cast<snapshot_request *>(data);
+	auto& cache = *request->cache;
+	const auto key = request->key;
+	delete request;
+
+	// Snapshots of pages which have not been drawn fail, and the
+	// previous thumbnail (if any) is kept.
+	auto snapshot = webkit_web_view_get_snapshot_finish(WEBKIT_WEB_VIEW(wv), result, nullptr);
+	if (snapshot && cairo_surface_get_type(snapshot) == CAIRO_SURFACE_TYPE_IMAGE &&
+		cache.capturing.count(key)) {
+
+		cache.push_job(job{job_kind::downscale, key, snapshot});
+		return;
+	}
+	if (snapshot) {
+		cairo_surface_destroy(snapshot);
+	}
+	cache.end_capture(key);
+}
+
+cairo_surface_t *snapshot_cache::get(uint64_t key) {
+	auto it = entries.find(key);
+	if (it == entries.end()) {
+		return nullptr;
+	}
+	auto& e = it->second;
+	if (e.surface) {
+		lru.splice(lru.begin(), lru, e.lru_pos);
+		return e.surface;
+	}
+	if (e.spilled && !e.loading) {
+		e.loading = true;
+		push_job(job{job_kind::load, key, nullptr});
+	}
+	return nullptr;
+}
+
+void snapshot_cache::erase(uint64_t key) {
+	capturing.erase(key);
+	auto it = entries.find(key);
+	if (it == entries.end()) {
+		return;
+	}
+	auto& e = it->second;
+	if (e.surface) {
+		used -= surface_size(e.surface);
+		cairo_surface_destroy(e.surface);
+		lru.erase(e.lru_pos);
+	}
+	if (e.spilled) {
+		push_job(job{job_kind::remove, key, nullptr});
+	}
+	entries.erase(it);
+}
+
+// end_capture counts a finished capture for key, returning false if the key
+// has since been erased.
+bool snapshot_cache::end_capture(uint64_t key) {
+	auto it = capturing.find(key);
+	if (it == capturing.end()) {
+		return false;
+	}
+	if (!--it->second) {
+		capturing.erase(it);
+	}
+	return true;
+}
+
+// insert makes a thumbnail the most recently used thumbnail for key,
+// replacing any earlier thumbnail.
+void snapshot_cache::insert(uint64_t key, cairo_surface_t *surface) {
+	auto& e = entries[key];
+	if (e.surface) {
+		used -= surface_size(e.surface);
+		cairo_surface_destroy(e.surface);
+		lru.erase(e.lru_pos);
+	}
+	e.surface = surface;
+	e.spilled = false;
+	e.loading = false;
+	lru.push_front(key);
+	e.lru_pos = lru.begin();
+	used += surface_size(surface);
+	enforce_budget();
+}
+
+// enforce_budget spills or drops the least recently used thumbnails until
+// the rest fit in the memory budget.
+void snapshot_cache::enforce_budget() {
+	while (used > policy.memory_budget && !lru.empty()) {
+		const auto key = lru.back();
+		lru.pop_back();
+		auto it = entries.find(key);
+		used -= surface_size(it->second.surface);
+		if (spill_directory.empty()) {
+			cairo_surface_destroy(it->second.surface);
+			entries.erase(it);
+			continue;
+		}
+		push_job(job{job_kind::spill, key, it->second.surface});
+		it->second.surface = nullptr;
+		it->second.spilled = true;
+	}
+}
+
+void snapshot_cache::push_job(job j) {
+	{
+		std::lock_guard<std::mutex> lock{mu};
+		jobs.push_back(j);
+	}
+	cv.notify_one();
+}
+
+// run performs jobs in order until the cache is destroyed, handing the
+// results of downscaling and loading to the main thread.  Jobs are done in
+// order, so a thumbnail is always written before it is read back.
+void snapshot_cache::run() {
+	std::unique_lock<std::mutex> lock{mu};
+	for (;;) {
+		cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+		if (stopping) {
+			break;
+		}
+		auto j = jobs.front();
+		jobs.pop_front();
+		lock.unlock();
+		run_job(j);
+		lock.lock();
+
+		if (j.kind == job_kind::downscale || j.kind == job_kind::load) {
+			results.push_back(j);
+			if (!results_source) {
+				results_source = gtk::idle_add(G_PRIORITY_DEFAULT_IDLE, *this,
+					on_results);
+			}
+		}
+	}
+
+	// Surfaces of jobs which were never run are released.
+	for (auto& j : jobs) {
+		if (j.surface) {
+			cairo_surface_destroy(j.surface);
+		}
+	}
+	jobs.clear();
+}
+
+void snapshot_cache::run_job(job& j) {
+	switch (j.kind) {
+	case job_kind::downscale: {
+		auto thumbnail = downscale(j.surface);
+		cairo_surface_destroy(j.surface);
+		j.surface = thumbnail;
+		break;
+	}
+	case job_kind::spill:
+		if (cairo_surface_write_to_png(j.surface, spill_path(j.key).c_str()) !=
+			CAIRO_STATUS_SUCCESS) {
+
+			g_warning("volo: unable to write %s", spill_path(j.key).c_str());
+		}
+		spilled_files.insert(j.key);
+		cairo_surface_destroy(j.surface);
+		j.surface = nullptr;
+		break;
+	case job_kind::load:
+		j.surface = cairo_image_surface_create_from_png(spill_path(j.key).c_str());
+		if (cairo_surface_status(j.surface) != CAIRO_STATUS_SUCCESS) {
+			cairo_surface_destroy(j.surface);
+			j.surface = nullptr;
+		}
+		break;
+	case job_kind::remove:
+		g_unlink(spill_path(j.key).c_str());
+		spilled_files.erase(j.key);
+		break;
+	}
+}
+
+bool snapshot_cache::on_results() {
+	std::deque<job> done;
+	{
+		std::lock_guard<std::mutex> lock{mu};
+		done.swap(results);
+		results_source = 0;
+	}
+
+	auto updated = false;
+	for (auto& j : done) {
+		// Thumbnails of tabs erased in the meantime are dropped, as
+		// are loads of thumbnails which were since replaced.  A
+		// thumbnail which could not be read back is forgotten.
+		auto it = entries.find(j.key);
+		auto wanted = j.kind == job_kind::downscale ? end_capture(j.key) :
+			it != entries.end() && it->second.loading;
+		if (wanted && !j.surface) {
+			entries.erase(it);
+			continue;
+		}
+		if (!wanted) {
+			if (j.surface) {
+				cairo_surface_destroy(j.surface);
+			}
+			continue;
+		}
+		insert(j.key, j.surface);
+		updated = true;
+	}
+	if (updated && changed) {
+		changed();
+	}
+	return G_SOURCE_REMOVE;
+}
@@ -0,0 +1,134 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_SNAPSHOT_CACHE_H
+#define _VOLO_SNAPSHOT_CACHE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <cairo.h>
+
+#include <stall_monitor.h>
+#include <webkit.h>
+
+namespace volo {
+
+// snapshot_policy limits the memory used by thumbnails.  Once the budget (in
+// bytes) is exceeded, the least recently used thumbnails are written to the
+// spill directory, if one is set, or otherwise dropped.  Thumbnails are
+// spilled into a new directory of this process's own inside it.
+struct snapshot_policy {
+	size_t memory_budget{32 << 20};
+	std::string spill_directory;
+};
+
+// snapshot_cache keeps a downscaled thumbnail of the page last shown by each
+// tab, identified by a key of the caller's choosing.
+//
+// Snapshots are taken by the web process, and are downscaled, written to
+// and read from the spill directory on a background thread, so the main
+// thread only waits to update the cache.  Thumbnails are only meaningful to
+// this process, so they are spilled into a uniquely named directory it
+// creates, which is removed, with the thumbnails written to it, as the cache
+// is destroyed.
+class snapshot_cache {
+public:
+	static const int thumbnail_width = 240;
+	static const int thumbnail_height = 150;
+
+private:
+	struct entry {
+		cairo_surface_t *surface{nullptr};
+		// Position in the LRU list while the surface is in memory.
+		std::list<uint64_t>::iterator lru_pos;
+		bool spilled{false};
+		bool loading{false};
+	};
+	std::unordered_map<uint64_t, entry> entries;
+	// Keys of thumbnails in memory, most recently used first.
+	std::list<uint64_t> lru;
+	// Number of snapshots being taken or downscaled for each key.
+	std::unordered_map<uint64_t, unsigned int> capturing;
+	snapshot_policy policy;
+	// The directory created for this process's thumbnails, or empty.
+	std::string spill_directory;
+	size_t used{0};
+	std::function<void()> changed;
+
+	enum class job_kind {
+		downscale,
+		spill,
+		load,
+		remove,
+	};
+	struct job {
+		job_kind kind;
+		uint64_t key;
+		cairo_surface_t *surface;
+	};
+	std::thread thread;
+	std::mutex mu;
+	std::condition_variable cv;
+	std::deque<job> jobs;
+	std::deque<job> results;
+	unsigned int results_source{0};
+	bool stopping{false};
+	// Keys of the thumbnails written to the spill directory, used only by
+	// the background thread until it is joined.
+	std::unordered_set<uint64_t> spilled_files;
+
+public:
+	explicit snapshot_cache(const snapshot_policy& = {});
+	~snapshot_cache();
+
+	snapshot_cache(const snapshot_cache&) = delete;
+	snapshot_cache& operator=(const snapshot_cache&) = delete;
+
+	// set_changed sets a function called whenever a thumbnail is added or
+	// loaded back into memory.
+	void set_changed(std::function<void()>);
+
+	// capture snapshots the visible region of a web_view, replacing the
+	// thumbnail for key once it has been downscaled.
+	void capture(uint64_t key, webkit::web_view&);
+
+	// get returns the thumbnail for key, marking it as recently used, or
+	// null if there is none in memory.  A spilled thumbnail is loaded in
+	// the background, and the changed function called once it is ready.
+	cairo_surface_t *get(uint64_t key);
+
+	// erase forgets the thumbnail for key.
+	void erase(uint64_t key);
+
+private:
+	void run();
+	void run_job(job&);
+	std::string spill_path(uint64_t key) const;
+	void remove_spill_directory();
+	void push_job(job);
+	bool end_capture(uint64_t key);
+	void insert(uint64_t key, cairo_surface_t *);
+	void enforce_budget();
+	bool on_results();
+
+	// Slots (static functions)
+	static void on_snapshot(GObject *wv, GAsyncResult *result, gpointer request);
+	static gboolean on_results(snapshot_cache *c) {
+		slot_timer t{"snapshot_cache::on_results"};
+		return c->on_results();
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_SNAPSHOT_CACHE_H
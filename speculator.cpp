@@ -0,0 +1,146 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#include <speculator.h>
+#include <uri.h>
+
+using namespace volo;
+
+// Time, in microseconds, after which a resolved host or opened connection is
+// no longer expected to help a navigation.
+const gint64 speculation_lifetime = 60 * G_USEC_PER_SEC;
+
+// Maximum number of recently prepared hosts remembered.
+const size_t max_recent = 32;
+
+// is_complete_host returns whether host looks like a full domain name, with
+// only valid characters and a top-level domain of at least two letters.
+static bool is_complete_host(const std::string& host) {
+	if (host == "localhost") {
+		return true;
+	}
+	if (!std::all_of(host.begin(), host.end(), [](unsigned char c) {
+		return isalnum(c) || c == '.' || c == '-';
+	})) {
+		return false;
+	}
+	auto dot = host.rfind('.');
+	if (dot == std::string::npos || dot == 0) {
+		return false;
+	}
+	auto tld = host.substr(dot + 1);
+	return tld.size() >= 2 &&
+		std::all_of(tld.begin(), tld.end(), [](unsigned char c) { return isalpha(c); });
+}
+
+// strip_scheme returns s without any scheme or leading "www.".
+static const char * strip_scheme(const char *s) {
+	auto sep = strstr(s, "://");
+	if (sep) {
+		s = sep + 3;
+	}
+	if (!strncmp(s, "www.", 4)) {
+		s += 4;
+	}
+	return s;
+}
+
+void speculator::append_stats(std::string& out) const {
+	char line[96];
+	snprintf(line, sizeof(line), "%lu %lu %lu %lu %lu\n", counters.navigations,
+		counters.dns_prefetches, counters.dns_hits,
+		counters.preconnects, counters.preconnect_hits);
+	out += "# speculation navigations dns_prefetches dns_hits preconnects preconnect_hits\n";
+	out += line;
+}
+
+// find returns the recent, unexpired preparation of host, or the end of
+// recent if there is none.
+std::deque<speculator::attempt>::iterator speculator::find(const std::string& host) {
+	auto now = g_get_monotonic_time();
+	while (!recent.empty() && now - recent.front().time >= speculation_lifetime) {
+		recent.pop_front();
+	}
+	return std::find_if(recent.begin(), recent.end(),
+		[&host](auto& a) { return a.host == host; });
+}
+
+void speculator::prefetch(const std::string& host) {
+	if (find(host) != recent.end()) {
+		return;
+	}
+	if (recent.size() == max_recent) {
+		recent.pop_front();
+	}
+	recent.push_back(attempt{host, g_get_monotonic_time(), false});
+	(context ? context : webkit::web_context::get_default())->prefetch_dns(host.c_str());
+	++counters.dns_prefetches;
+}
+
+void speculator::preconnect(const std::string& origin, const std::string& host,
+	webkit::web_view& wv) {
+
+	prefetch(host);
+	auto a = find(host);
+	if (a->preconnected) {
+		return;
+	}
+	a->preconnected = true;
+
+	// The network process is shared by all web_views, so a connection
+	// opened for the (blank) preconnect view is reused by the
+	// navigation.  The origin only holds host name characters, as
+	// checked by is_complete_host, and so needs no escaping.
+	wv.run_javascript("(function(){var l=document.createElement('link');"
+		"l.rel='preconnect';l.href='" + origin + "';"
+		"document.head.appendChild(l);})()");
+	++counters.preconnects;
+}
+
+void speculator::speculate(const std::string& text, const std::string& uri,
+	const std::string& top_uri, webkit::web_view *preconnect_view) {
+
+	std::string origin, host;
+	if (uri_origin(uri, origin, host) && is_complete_host(host)) {
+		prefetch(host);
+	}
+
+	// The top suggestion is a likely destination when the typed text
+	// begins it, as when completing a previously visited host.
+	auto typed = strip_scheme(text.c_str());
+	if (!*typed || top_uri.empty() ||
+		strncasecmp(strip_scheme(top_uri.c_str()), typed, strlen(typed)) ||
+		!uri_origin(top_uri, origin, host) || !is_complete_host(host)) {
+
+		return;
+	}
+	if (preconnect_view && origin.find_first_of("'\\\"") == std::string::npos) {
+		preconnect(origin, host, *preconnect_view);
+	} else {
+		prefetch(host);
+	}
+}
+
+void speculator::navigated(const char *uri) {
+	++counters.navigations;
+	std::string origin, host;
+	if (!uri_origin(uri, origin, host)) {
+		return;
+	}
+	auto a = find(host);
+	if (a == recent.end()) {
+		return;
+	}
+	++counters.dns_hits;
+	if (a->preconnected) {
+		++counters.preconnect_hits;
+	}
+	// Each preparation is only counted as useful once.
+	recent.erase(a);
+}
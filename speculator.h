@@ -0,0 +1,75 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_SPECULATOR_H
+#define _VOLO_SPECULATOR_H
+
+#include <deque>
+#include <string>
+
+#include <glib.h>
+
+#include <webkit.h>
+
+namespace volo {
+
+// speculator prepares the network for a navigation while its URI is still
+// being typed.  The host of the typed URI is resolved when it looks like a
+// complete host name.  When the typed text begins the top history
+// suggestion, that suggestion's host is resolved, and a connection to it
+// opened, as well.
+//
+// Navigations are compared against recent speculation, counting how often
+// it was useful.
+class speculator {
+public:
+	struct stats {
+		unsigned long dns_prefetches{0};
+		unsigned long preconnects{0};
+		unsigned long navigations{0};
+		// Navigations to a host resolved, or connected to, shortly
+		// before.
+		unsigned long dns_hits{0};
+		unsigned long preconnect_hits{0};
+	};
+
+private:
+	struct attempt {
+		std::string host;
+		gint64 time;
+		bool preconnected;
+	};
+	// Recently prepared hosts, most recent last.
+	std::deque<attempt> recent;
+	stats counters;
+	webkit::web_context *context;
+
+public:
+	// Hosts are resolved by context, or the default context if null.
+	explicit speculator(webkit::web_context *context = nullptr) : context{context} {}
+
+	// speculate prepares for a navigation to uri (the typed text, with
+	// a scheme guessed if necessary) or to the top history suggestion
+	// top_uri, which may be empty.  Connections are opened by a script
+	// run in preconnect_view, which should show a blank page; if it is
+	// null, hosts are only resolved.
+	void speculate(const std::string& text, const std::string& uri,
+		const std::string& top_uri, webkit::web_view *preconnect_view);
+
+	// navigated records a navigation to uri begun from the URI entry.
+	void navigated(const char *uri);
+
+	// append_stats appends a line of the numbers of typed navigations,
+	// and of speculations made and used.
+	void append_stats(std::string&) const;
+
+private:
+	std::deque<attempt>::iterator find(const std::string& host);
+	void prefetch(const std::string& host);
+	void preconnect(const std::string& origin, const std::string& host, webkit::web_view&);
+};
+
+} // namespace volo
+
+#endif // _VOLO_SPECULATOR_H
@@ -0,0 +1,105 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <stall_monitor.h>
+
+using namespace volo;
+
+gint64 stall_monitor::threshold{0};
+std::unordered_map<std::string, stall_monitor::stats> stall_monitor::long_tasks;
+stall_monitor::stats stall_monitor::long_frames;
+unsigned long stall_monitor::missed_frames{0};
+gint64 stall_monitor::paint_started{0};
+
+void stall_monitor::enable(unsigned int threshold_ms) {
+	threshold = gint64{threshold_ms} * 1000;
+}
+
+void stall_monitor::slot_finished(const char *name, gint64 start) {
+	const auto duration = g_get_monotonic_time() - start;
+	if (duration < threshold) {
+		return;
+	}
+	g_message("volo: long task: %s took %.1f ms", name, duration / 1000.0);
+	auto& s = long_tasks[name];
+	++s.count;
+	s.worst = std::max(s.worst, duration);
+}
+
+void stall_monitor::watch_frames(GtkWidget *window) {
+	if (!enabled()) {
+		return;
+	}
+	if (gtk_widget_get_realized(window)) {
+		on_realize(window, nullptr);
+	} else {
+		g_signal_connect(window, "realize", G_CALLBACK(on_realize), nullptr);
+	}
+}
+
+void stall_monitor::on_realize(GtkWidget *window, gpointer) {
+	auto clock = gtk_widget_get_frame_clock(window);
+	if (!clock) {
+		return;
+	}
+	g_signal_connect(clock, "before-paint", G_CALLBACK(on_before_paint), nullptr);
+	g_signal_connect(clock, "after-paint", G_CALLBACK(on_after_paint), nullptr);
+}
+
+void stall_monitor::on_before_paint(GdkFrameClock *, gpointer) {
+	paint_started = g_get_monotonic_time();
+}
+
+void stall_monitor::on_after_paint(GdkFrameClock *clock, gpointer) {
+	if (!paint_started) {
+		return;
+	}
+	const auto duration = g_get_monotonic_time() - paint_started;
+	paint_started = 0;
+
+	gint64 refresh_interval, presentation_time;
+	gdk_frame_clock_get_refresh_info(clock, gdk_frame_clock_get_frame_time(clock),
+		&refresh_interval, &presentation_time);
+	if (refresh_interval <= 0 || duration <= refresh_interval) {
+		return;
+	}
+	const auto missed = duration / refresh_interval;
+	missed_frames += missed;
+	if (duration >= threshold) {
+		g_message("volo: long frame: took %.1f ms, missing %lld refreshes",
+			duration / 1000.0, static_cast<long long>(missed));
+		++long_frames.count;
+		long_frames.worst = std::max(long_frames.worst, duration);
+	}
+}
+
+void stall_monitor::append_stats(std::string& out) {
+	if (!enabled()) {
+		return;
+	}
+	std::vector<const std::pair<const std::string, stats> *> sorted;
+	for (auto& t : long_tasks) {
+		sorted.push_back(&t);
+	}
+	std::sort(sorted.begin(), sorted.end(),
+		[](auto a, auto b) { return a->second.worst > b->second.worst; });
+
+	char line[64];
+	out += "# long tasks count worst_ms slot\n";
+	for (auto t : sorted) {
+		snprintf(line, sizeof(line), "%lu %.1f ", t->second.count,
+			t->second.worst / 1000.0);
+		out += line;
+		out += t->first;
+		out += '\n';
+	}
+	out += "# frames long_count worst_ms missed\n";
+	snprintf(line, sizeof(line), "%lu %.1f %lu\n", long_frames.count,
+		long_frames.worst / 1000.0, missed_frames);
+	out += line;
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_STALL_MONITOR_H
+#define _VOLO_STALL_MONITOR_H
+
+#include <string>
+#include <unordered_map>
+
+#include <gtk/gtk.h>
+
+namespace volo {
+
+// stall_monitor finds work on the main thread long enough to delay input and
+// drawing.  While it is enabled, every slot is timed, and each which runs for
+// longer than the threshold is logged as a long task, naming the slot.  Slots
+// run by another slot (such as by a signal emitted synchronously) are timed
+// as well, and also count towards the slot running them.
+//
+// The frame clocks of watched windows are followed too.  A frame whose
+// update, layout and paint take longer than the refresh interval misses the
+// display's refresh, and is logged once longer than the threshold.
+//
+// Monitoring is disabled by default, when timing a slot costs no more than
+// testing whether it is enabled.
+class stall_monitor {
+private:
+	struct stats {
+		unsigned long count{0};
+		gint64 worst{0};
+	};
+
+	// Threshold of a long task in microseconds, or zero when disabled.
+	static gint64 threshold;
+	static std::unordered_map<std::string, stats> long_tasks;
+	static stats long_frames;
+	static unsigned long missed_frames;
+	static gint64 paint_started;
+
+public:
+	stall_monitor() = delete;
+
+	// enable begins monitoring, logging tasks longer than the threshold
+	// in milliseconds.
+	static void enable(unsigned int threshold_ms);
+
+	static bool enabled() { return threshold != 0; }
+
+	// slot_finished records a slot which began at the monotonic time
+	// start and has just returned.
+	static void slot_finished(const char *name, gint64 start);
+
+	// watch_frames follows the frame clock of a window once it is
+	// realized.  It does nothing while monitoring is disabled.
+	static void watch_frames(GtkWidget *window);
+
+	// append_stats appends a line for each slot which ran as a long
+	// task, with the number of long tasks and the longest in
+	// milliseconds, followed by the long and missed frames.
+	static void append_stats(std::string&);
+
+private:
+	static void on_realize(GtkWidget *, gpointer);
+	static void on_before_paint(GdkFrameClock *, gpointer);
+	static void on_after_paint(GdkFrameClock *, gpointer);
+};
+
+// slot_timer times a slot from its construction until it is destroyed, and
+// is declared first by the slots (static functions) of each class.
+class slot_timer {
+private:
+	const char *name;
+	gint64 start;
+
+public:
+	explicit slot_timer(const char *name) :
+		name{name}, start{stall_monitor::enabled() ? g_get_monotonic_time() : 0} {}
+	~slot_timer() {
+		if (start) {
+			stall_monitor::slot_finished(name, start);
+		}
+	}
+
+	slot_timer(const slot_timer&) = delete;
+	slot_timer& operator=(const slot_timer&) = delete;
+};
+
+} // namespace volo
+
+#endif // _VOLO_STALL_MONITOR_H
@@ -0,0 +1,218 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+
+#include <gdk/gdkkeysyms.h>
+
+#include <tab_overview.h>
+
+using namespace volo;
+
+// Layout of the grid, in pixels.  Each cell is a thumbnail with the tab's
+// title beneath it.
+static const int spacing = 16;
+static const int title_height = 24;
+static const int cell_width = snapshot_cache::thumbnail_width;
+static const int cell_height = snapshot_cache::thumbnail_height + title_height;
+static const int column_pitch = cell_width + spacing;
+static const int row_pitch = cell_height + spacing;
+
+// Width of the highlight around the selected cell.
+static const int highlight_width = 4;
+
+tab_overview::tab_overview() :
+	scroller{gtk::make_sunk<gtk::scrolled_window>()},
+	area{gtk::make_sunk<gtk::drawing_area>()} {
+
+	scroller->set_policy(GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+	scroller->set_vexpand(true);
+	scroller->set_hexpand(true);
+	scroller->set_no_show_all(true);
+	scroller->add(*area);
+
+	area->add_events(GDK_BUTTON_PRESS_MASK);
+	area->connect_draw(*this, on_draw);
+	area->connect_button_press_event(*this, on_button_press_event);
+	area->connect_size_allocate(*this, on_size_allocate);
+	area->show();
+}
+
+void tab_overview::set_snapshot_cache(snapshot_cache& cache) {
+	snapshots = &cache;
+}
+
+void tab_overview::set_activated(std::function<void(size_t)> f) {
+	activated = std::move(f);
+}
+
+void tab_overview::show(std::vector<item> new_items, size_t new_selected) {
+	items = std::move(new_items);
+	selected = std::min(new_selected, items.empty() ? 0 : items.size() - 1);
+	update_layout();
+	scroller->show();
+	area->queue_draw();
+	scroll_to_selected();
+}
+
+void tab_overview::hide() {
+	scroller->hide();
+	items.clear();
+}
+
+bool tab_overview::is_shown() const {
+	return scroller->get_visible();
+}
+
+void tab_overview::redraw() {
+	if (is_shown()) {
+		area->queue_draw();
+	}
+}
+
+// update_layout fits as many columns as the width allows, and sizes the
+// drawing area to hold every row.
+void tab_overview::update_layout() {
+	columns = std::max(1, (width - spacing) / column_pitch);
+	const auto rows = (int(items.size()) + columns - 1) / columns;
+	area->set_size_request(-1, spacing + rows * row_pitch);
+}
+
+void tab_overview::cell_origin(size_t n, double& x, double& y) const {
+	// The columns are centered horizontally.
+	const auto margin = std::max(spacing, (width - columns * column_pitch + spacing) / 2);
+	x = margin + int(n % columns) * column_pitch;
+	y = spacing + int(n / columns) * row_pitch;
+}
+
+bool tab_overview::item_at(double x, double y, size_t& n) const {
+	double x0, y0;
+	cell_origin(0, x0, y0);
+	if (x < x0 || y < y0) {
+		return false;
+	}
+	const auto column = int(x - x0) / column_pitch;
+	const auto row = int(y - y0) / row_pitch;
+	if (column >= columns || int(x - x0) % column_pitch >= cell_width ||
+		int(y - y0) % row_pitch >= cell_height) {
+
+		return false;
+	}
+	n = size_t(row) * columns + column;
+	return n < items.size();
+}
+
+void tab_overview::select(size_t n) {
+	if (n >= items.size()) {
+		return;
+	}
+	selected = n;
+	area->queue_draw();
+	scroll_to_selected();
+}
+
+void tab_overview::scroll_to_selected() {
+	double x, y;
+	cell_origin(selected, x, y);
+	scroller->scroll_to_show(y - spacing, y + cell_height + spacing);
+}
+
+bool tab_overview::key_press(GdkEventKey& ev) {
+	if (items.empty() || (ev.state & gtk_accelerator_get_default_mod_mask())) {
+		return false;
+	}
+	const auto last = items.size() - 1;
+	switch (ev.keyval) {
+	case GDK_KEY_Left:
+		select(selected ? selected - 1 : 0);
+		return true;
+	case GDK_KEY_Right:
+		select(std::min(selected + 1, last));
+		return true;
+	case GDK_KEY_Up:
+		select(selected >= size_t(columns) ? selected - columns : selected);
+		return true;
+	case GDK_KEY_Down:
+		select(selected + columns <= last ? selected + columns : selected);
+		return true;
+	case GDK_KEY_Home:
+		select(0);
+		return true;
+	case GDK_KEY_End:
+		select(last);
+		return true;
+	case GDK_KEY_Return:
+	case GDK_KEY_KP_Enter:
+		if (activated) {
+			activated(selected);
+		}
+		return true;
+	}
+	return false;
+}
+
+bool tab_overview::on_draw(cairo_t& cr) {
+	auto widget = GTK_WIDGET(area->ptr());
+	auto style = gtk_widget_get_style_context(widget);
+	GdkRGBA highlight;
+	if (!gtk_style_context_lookup_color(style, "theme_selected_bg_color", &highlight)) {
+		highlight = GdkRGBA{0.2, 0.4, 0.8, 1.0};
+	}
+	auto layout = gtk_widget_create_pango_layout(widget, nullptr);
+	pango_layout_set_width(layout, cell_width * PANGO_SCALE);
+	pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_END);
+
+	// Only the rows within the clip are drawn.
+	double x1, y1, x2, y2;
+	cairo_clip_extents(&cr, &x1, &y1, &x2, &y2);
+	const auto first = size_t(std::max(0, int(y1 - spacing) / row_pitch)) * columns;
+	const auto end = std::min(items.size(), size_t(int(y2) / row_pitch + 1) * columns);
+	for (auto n = first; n < end; ++n) {
+		double x, y;
+		cell_origin(n, x, y);
+
+		if (n == selected) {
+			gdk_cairo_set_source_rgba(&cr, &highlight);
+			cairo_rectangle(&cr, x - highlight_width, y - highlight_width,
+				cell_width + 2 * highlight_width, cell_height + 2 * highlight_width);
+			cairo_fill(&cr);
+		}
+
+		cairo_set_source_rgb(&cr, 1, 1, 1);
+		cairo_rectangle(&cr, x, y, cell_width, snapshot_cache::thumbnail_height);
+		cairo_fill(&cr);
+		if (auto thumbnail = snapshots ? snapshots->get(items[n].key) : nullptr) {
+			cairo_set_source_surface(&cr, thumbnail, x, y);
+			cairo_rectangle(&cr, x, y, cairo_image_surface_get_width(thumbnail),
+				cairo_image_surface_get_height(thumbnail));
+			cairo_fill(&cr);
+		}
+
+		pango_layout_set_text(layout, items[n].title.c_str(), -1);
+		gtk_render_layout(style, &cr, x, y + snapshot_cache::thumbnail_height + 4, layout);
+	}
+	g_object_unref(layout);
+	return true;
+}
+
+bool tab_overview::on_button_press_event(GdkEventButton& ev) {
+	size_t n;
+	if (ev.type != GDK_BUTTON_PRESS || ev.button != 1 || !item_at(ev.x, ev.y, n)) {
+		return false;
+	}
+	select(n);
+	if (activated) {
+		activated(n);
+	}
+	return true;
+}
+
+void tab_overview::on_size_allocate(GdkRectangle& allocation) {
+	if (allocation.width == width) {
+		return;
+	}
+	width = allocation.width;
+	update_layout();
+	scroll_to_selected();
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_TAB_OVERVIEW_H
+#define _VOLO_TAB_OVERVIEW_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <gtk.h>
+#include <snapshot_cache.h>
+#include <stall_monitor.h>
+
+namespace volo {
+
+// tab_overview shows every tab at once, as a grid of thumbnails each above
+// the title of its tab.  Tabs without a thumbnail are drawn as blank pages.
+//
+// The grid is drawn by a single widget, which draws only the rows scrolled
+// into view, so showing the overview costs about the same with hundreds of
+// tabs as with a few.
+class tab_overview {
+public:
+	// item describes a tab, by the key of its thumbnail in the snapshot
+	// cache and its title.
+	struct item {
+		uint64_t key;
+		std::string title;
+	};
+
+private:
+	gtk::unique_ptr<gtk::scrolled_window> scroller;
+	gtk::unique_ptr<gtk::drawing_area> area;
+	snapshot_cache *snapshots{nullptr};
+	std::function<void(size_t)> activated;
+	std::vector<item> items;
+	size_t selected{0};
+	int width{0};
+	int columns{1};
+
+public:
+	tab_overview();
+
+	// widget returns the overview's widget, to be added to the browser
+	// window.  It is hidden until the overview is shown.
+	gtk::scrolled_window& widget() { return *scroller; }
+
+	// set_snapshot_cache sets the cache of the thumbnails drawn for
+	// each item.
+	void set_snapshot_cache(snapshot_cache&);
+
+	// set_activated sets the function called with the index of an item
+	// chosen by the user.
+	void set_activated(std::function<void(size_t)>);
+
+	// show shows the overview of items, with the selected item
+	// highlighted and scrolled into view.
+	void show(std::vector<item>, size_t selected);
+	void hide();
+	bool is_shown() const;
+
+	// redraw draws the overview again, once its thumbnails have changed.
+	void redraw();
+
+	// key_press moves the selection with the arrow, Home and End keys,
+	// and chooses the selected item with Enter, returning whether the
+	// key was handled.
+	bool key_press(GdkEventKey&);
+
+private:
+	void update_layout();
+	void select(size_t);
+	void scroll_to_selected();
+	bool item_at(double x, double y, size_t&) const;
+	void cell_origin(size_t, double& x, double& y) const;
+
+	// Slots (member functions)
+	bool on_draw(cairo_t&);
+	bool on_button_press_event(GdkEventButton&);
+	void on_size_allocate(GdkRectangle&);
+
+	// Slots (static functions)
+	static gboolean on_draw(gtk::drawing_area *, cairo_t *cr, tab_overview *o) {
+		slot_timer t{"tab_overview::on_draw"};
+		return o->on_draw(*cr);
+	}
+	static gboolean on_button_press_event(gtk::drawing_area *, GdkEventButton *ev,
+		tab_overview *o) {
+
+		slot_timer t{"tab_overview::on_button_press_event"};
+		return o->on_button_press_event(*ev);
+	}
+	static void on_size_allocate(gtk::drawing_area *, GdkRectangle *allocation,
+		tab_overview *o) {
+
+		slot_timer t{"tab_overview::on_size_allocate"};
+		o->on_size_allocate(*allocation);
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_TAB_OVERVIEW_H
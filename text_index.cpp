@@ -0,0 +1,555 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include <encoding.h>
+#include <text_index.h>
+
+using namespace volo;
+
+// Words shorter or longer than these lengths, in bytes, are not indexed.
+const size_t min_term_length = 3;
+const size_t max_term_length = 32;
+
+// Pages with more distinct terms than this keep only their most frequent.
+const size_t max_terms_per_page = 2048;
+
+// Characters of each page's text which are indexed.
+const unsigned int max_page_text = 200000;
+
+// A word of a query matches at most this many terms it prefixes.
+const size_t max_prefix_terms = 64;
+
+// Indexed pages are written as a new segment once this many are waiting, or
+// once the oldest has waited flush_interval.
+const size_t flush_pages = 32;
+const std::chrono::seconds flush_interval{60};
+
+// Segments are merged at startup when there are more than max_segments, or
+// more than a quarter of their pages have been replaced.
+const size_t max_segments = 16;
+
+// A segment begins with a magic string, a version, and the numbers of pages
+// and terms it holds, followed by
+//
+//	for each page:
+//		u32 URI length
+//		    URI
+//		u32 title length
+//		    title
+//	for each term, in increasing order:
+//		u8  term length
+//		    term
+//		u32 posting list length
+//		    posting list: varint deltas of the numbers of the pages
+//		    (within the segment) containing the term
+//
+// with integers in host byte order.
+static const char segment_magic[8] = {'v', 'o', 'l', 'o', 't', 'e', 'x', 't'};
+const uint32_t segment_version = 1;
+
+// Script returning the URI, title and text of a page, one per line, and the
+// isolated world it is run in.
+static const std::string extract_script =
+	"location.href + '\\n' + document.title.replace(/\\n/g, ' ') + '\\n' + "
+	"(document.body ? document.body.innerText.slice(0, " +
+	std::to_string(max_page_text) + ") : '')";
+static const char script_world[] = "volo-text-index";
+
+static void put_varint(std::string& s, uint32_t v) {
+	for (; v >= 0x80; v >>= 7) {
+		s.push_back(char(v | 0x80));
+	}
+	s.push_back(char(v));
+}
+
+// decode_postings appends the page numbers of a posting list to ids,
+// returning false if it is truncated.
+static bool decode_postings(const char *p, const char *end, std::vector<uint32_t>& ids) {
+	uint32_t id = 0;
+	for (auto first = true; p != end; first = false) {
+		uint32_t delta = 0;
+		for (unsigned int shift = 0; ; shift += 7) {
+			if (p == end || shift > 28) {
+				return false;
+			}
+			auto b = static_cast<unsigned char>(*p++);
+			delta |= uint32_t(b & 0x7f) << shift;
+			if (!(b & 0x80)) {
+				break;
+			}
+		}
+		id = first ? delta : id + delta;
+		ids.push_back(id);
+	}
+	return true;
+}
+
+// split_words appends the words of text, lowercased, to words.  A word is a
+// run of letters and digits of an indexable length.
+static void split_words(const char *text, std::vector<std::string>& words) {
+	auto lower = g_utf8_strdown(text, -1);
+	std::string word;
+	auto end_word = [&] {
+		if (word.size() >= min_term_length && word.size() <= max_term_length) {
+			words.push_back(word);
+		}
+		word.clear();
+	};
+	for (auto p = lower; *p; ) {
+		auto next = g_utf8_next_char(p);
+		if (g_unichar_isalnum(g_utf8_get_char(p))) {
+			word.append(p, next - p);
+		} else {
+			end_word();
+		}
+		p = next;
+	}
+	end_word();
+	g_free(lower);
+}
+
+// parse_page splits the URI, title and text returned by the extract script
+// into the page to be indexed.
+static indexed_page parse_page(const std::string& extracted) {
+	indexed_page page;
+	auto uri_end = extracted.find('\n');
+	auto title_end = uri_end == std::string::npos ? uri_end :
+		extracted.find('\n', uri_end + 1);
+	if (title_end == std::string::npos) {
+		return page;
+	}
+	page.uri = extracted.substr(0, uri_end);
+	page.title = extracted.substr(uri_end + 1, title_end - uri_end - 1);
+
+	std::vector<std::string> words;
+	split_words(extracted.c_str() + title_end + 1, words);
+	split_words(page.title.c_str(), words);
+	std::unordered_map<std::string, unsigned int> counts;
+	for (auto& w : words) {
+		++counts[w];
+	}
+	std::vector<std::pair<unsigned int, const std::string *>> by_count;
+	by_count.reserve(counts.size());
+	for (auto& c : counts) {
+		by_count.emplace_back(c.second, &c.first);
+	}
+	if (by_count.size() > max_terms_per_page) {
+		std::nth_element(by_count.begin(), by_count.begin() + max_terms_per_page,
+			by_count.end(), [](auto& a, auto& b) { return a.first > b.first; });
+		by_count.resize(max_terms_per_page);
+	}
+	page.terms.reserve(by_count.size());
+	for (auto& c : by_count) {
+		page.terms.push_back(*c.second);
+	}
+	std::sort(page.terms.begin(), page.terms.end());
+	return page;
+}
+
+static std::string encode_segment(const std::vector<indexed_page>& pages) {
+	std::map<std::string, std::vector<uint32_t>> lists;
+	for (uint32_t i = 0; i < pages.size(); ++i) {
+		for (auto& term : pages[i].terms) {
+			lists[term].push_back(i);
+		}
+	}
+
+	auto out = std::string{segment_magic, sizeof(segment_magic)};
+	put_u32(out, segment_version);
+	put_u32(out, pages.size());
+	put_u32(out, lists.size());
+	for (auto& page : pages) {
+		put_u32(out, page.uri.size());
+		out += page.uri;
+		put_u32(out, page.title.size());
+		out += page.title;
+	}
+	std::string deltas;
+	for (auto& list : lists) {
+		out.push_back(char(list.first.size()));
+		out += list.first;
+		deltas.clear();
+		for (size_t i = 0; i < list.second.size(); ++i) {
+			put_varint(deltas, i ? list.second[i] - list.second[i - 1] : list.second[i]);
+		}
+		put_u32(out, deltas.size());
+		out += deltas;
+	}
+	return out;
+}
+
+// segment_reader reads the fields of a segment, failing once any would
+// extend past its end.
+struct segment_reader {
+	const char *p;
+	const char *end;
+
+	bool get_u32(uint32_t& v) {
+		if (size_t(end - p) < sizeof(v)) {
+			return false;
+		}
+		v = volo::get_u32(p);
+		p += sizeof(v);
+		return true;
+	}
+	bool get_bytes(size_t n, std::string& s) {
+		if (size_t(end - p) < n) {
+			return false;
+		}
+		s.assign(p, n);
+		p += n;
+		return true;
+	}
+};
+
+// decode_segment appends the pages of a segment, with their terms, to pages,
+// returning false if the segment is not recognized or is truncated.
+static bool decode_segment(const char *data, size_t size, std::vector<indexed_page>& pages) {
+	auto r = segment_reader{data, data + size};
+	std::string magic;
+	uint32_t version, n_pages, n_terms, len;
+	if (!r.get_bytes(sizeof(segment_magic), magic) ||
+		memcmp(magic.data(), segment_magic, sizeof(segment_magic)) ||
+		!r.get_u32(version) || version != segment_version ||
+		!r.get_u32(n_pages) || !r.get_u32(n_terms) || n_pages > size) {
+
+		return false;
+	}
+
+	const auto first = pages.size();
+	pages.resize(first + n_pages);
+	for (auto i = first; i < pages.size(); ++i) {
+		if (!r.get_u32(len) || !r.get_bytes(len, pages[i].uri) ||
+			!r.get_u32(len) || !r.get_bytes(len, pages[i].title)) {
+
+			return false;
+		}
+	}
+	std::string term;
+	std::vector<uint32_t> ids;
+	for (uint32_t i = 0; i < n_terms; ++i) {
+		if (r.p == r.end || !r.get_bytes(static_cast<unsigned char>(*r.p++), term) ||
+			!r.get_u32(len) || size_t(r.end - r.p) < len) {
+
+			return false;
+		}
+		ids.clear();
+		if (!decode_postings(r.p, r.p + len, ids)) {
+			return false;
+		}
+		r.p += len;
+		for (auto id : ids) {
+			if (id >= n_pages) {
+				return false;
+			}
+			pages[first + id].terms.push_back(term);
+		}
+	}
+	return true;
+}
+
+void page_text_index::add(const indexed_page& page) {
+	const auto id = uint32_t(docs.size());
+	auto it = doc_by_uri.find(page.uri);
+	if (it != doc_by_uri.end()) {
+		docs[it->second].live = false;
+		++dead;
+		it->second = id;
+	} else {
+		doc_by_uri.emplace(page.uri, id);
+	}
+	docs.push_back(document{page.uri, page.title, true});
+
+	for (auto& term : page.terms) {
+		auto& list = postings[term];
+		put_varint(list.deltas, list.deltas.empty() ? id : id - list.last);
+		list.last = id;
+	}
+}
+
+// prefix_matches returns the sorted numbers of the pages containing a term
+// beginning with word.
+std::vector<uint32_t> page_text_index::prefix_matches(const std::string& word) const {
+	std::vector<uint32_t> ids;
+	size_t terms = 0;
+	for (auto it = postings.lower_bound(word); it != postings.end() &&
+		terms < max_prefix_terms && !it->first.compare(0, word.size(), word); ++it) {
+
+		auto& deltas = it->second.deltas;
+		decode_postings(deltas.data(), deltas.data() + deltas.size(), ids);
+		++terms;
+	}
+	if (terms > 1) {
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+	}
+	return ids;
+}
+
+void page_text_index::query(const std::string& text, size_t limit,
+	std::vector<text_match>& results) const {
+
+	std::vector<std::string> words;
+	split_words(text.c_str(), words);
+	if (words.empty()) {
+		return;
+	}
+
+	// Intersect the pages matching each word, starting from the first.
+	auto matches = prefix_matches(words.front());
+	std::vector<uint32_t> next, both;
+	for (size_t i = 1; i < words.size() && !matches.empty(); ++i) {
+		next = prefix_matches(words[i]);
+		both.clear();
+		std::set_intersection(matches.cbegin(), matches.cend(), next.cbegin(),
+			next.cend(), std::back_inserter(both));
+		matches.swap(both);
+	}
+
+	for (auto it = matches.crbegin(); it != matches.crend() && limit; ++it) {
+		auto& doc = docs[*it];
+		if (doc.live) {
+			results.push_back(text_match{doc.uri, doc.title});
+			--limit;
+		}
+	}
+}
+
+std::vector<indexed_page> page_text_index::live_pages() const {
+	std::vector<indexed_page> pages(docs.size());
+	std::vector<uint32_t> ids;
+	for (auto& list : postings) {
+		ids.clear();
+		decode_postings(list.second.deltas.data(),
+			list.second.deltas.data() + list.second.deltas.size(), ids);
+		for (auto id : ids) {
+			if (docs[id].live) {
+				pages[id].terms.push_back(list.first);
+			}
+		}
+	}
+
+	size_t n = 0;
+	for (size_t id = 0; id < docs.size(); ++id) {
+		if (docs[id].live) {
+			pages[id].uri = docs[id].uri;
+			pages[id].title = docs[id].title;
+			pages[n++] = std::move(pages[id]);
+		}
+	}
+	pages.resize(n);
+	return pages;
+}
+
+text_index::~text_index() {
+	if (thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock{mu};
+			stopping = true;
+		}
+		cv.notify_one();
+		thread.join();
+	}
+	if (lock_fd != -1) {
+		close(lock_fd);
+	}
+}
+
+bool text_index::open() {
+	auto d = g_build_filename(g_get_user_data_dir(), "volo", "text_index", nullptr);
+	g_mkdir_with_parents(d, 0700);
+	dir = d;
+	g_free(d);
+
+	// Segment names are chosen, and merged segments removed, as the
+	// index is loaded, so only one browser process may use it.
+	auto lock_path = dir + "/lock";
+	lock_fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (lock_fd == -1 || flock(lock_fd, LOCK_EX | LOCK_NB) == -1) {
+		if (lock_fd != -1) {
+			close(lock_fd);
+			lock_fd = -1;
+		}
+		return false;
+	}
+
+	thread = std::thread{&text_index::run, this};
+	return true;
+}
+
+void text_index::page_loaded(webkit::web_view& wv) {
+	auto uri = wv.get_uri();
+	if (!thread.joinable() ||
+		(strncmp(uri, "http://", 7) && strncmp(uri, "https://", 8))) {
+
+		return;
+	}
+	// The script runs in a world of its own, so that the page cannot
+	// alter what it extracts or the format parse_page expects.
+	wv.run_javascript_in_world(extract_script.c_str(), script_world,
+		on_text_extracted, this);
+}
+
+void text_index::on_text_extracted(GObject *wv, GAsyncResult *result) {
+	GError *error = nullptr;
+	auto js = webkit_web_view_run_javascript_in_world_finish(WEBKIT_WEB_VIEW(wv),
+		result, &error);
+	if (!js) {
+		// The page may have been closed or navigated away from.
+		g_error_free(error);
+		return;
+	}
+	auto text = jsc_value_to_string(webkit_javascript_result_get_js_value(js));
+	{
+		std::lock_guard<std::mutex> lock{mu};
+		queue.emplace_back(text);
+	}
+	cv.notify_one();
+	g_free(text);
+	webkit_javascript_result_unref(js);
+}
+
+void text_index::query(const std::string& text, size_t limit, std::vector<text_match>& results) {
+	std::lock_guard<std::mutex> lock{mu};
+	index.query(text, limit, results);
+}
+
+std::string text_index::segment_path(unsigned int n) const {
+	char name[16];
+	snprintf(name, sizeof(name), "%08u.seg", n);
+	return dir + '/' + name;
+}
+
+bool text_index::write_segment(unsigned int n, const std::vector<indexed_page>& pages) const {
+	auto data = encode_segment(pages);
+	GError *error = nullptr;
+	if (!g_file_set_contents(segment_path(n).c_str(), data.data(), data.size(), &error)) {
+		g_warning("volo: writing text index: %s", error->message);
+		g_error_free(error);
+		return false;
+	}
+	return true;
+}
+
+// load reads every segment into a new index, merging them if needed, and
+// then replaces the (until then empty) index with it.
+void text_index::load() {
+	std::vector<unsigned int> found;
+	if (auto d = g_dir_open(dir.c_str(), 0, nullptr)) {
+		while (auto name = g_dir_read_name(d)) {
+			unsigned int n;
+			char ext[5];
+			if (sscanf(name, "%8u.%4s", &n, ext) == 2 && !strcmp(ext, "seg")) {
+				found.push_back(n);
+			}
+		}
+		g_dir_close(d);
+	}
+	std::sort(found.begin(), found.end());
+
+	page_text_index idx;
+	std::vector<indexed_page> pages;
+	for (auto n : found) {
+		gchar *data;
+		gsize size;
+		if (!g_file_get_contents(segment_path(n).c_str(), &data, &size, nullptr)) {
+			continue;
+		}
+		pages.clear();
+		if (!decode_segment(data, size, pages)) {
+			g_warning("volo: ignoring unrecognized text index segment %s",
+				segment_path(n).c_str());
+			pages.clear();
+		}
+		g_free(data);
+		for (auto& page : pages) {
+			idx.add(page);
+		}
+	}
+	next_segment = found.empty() ? 0 : found.back() + 1;
+
+	if (found.size() > max_segments || idx.dead_pages() * 4 > idx.size() + idx.dead_pages()) {
+		auto live = idx.live_pages();
+		if (write_segment(next_segment, live)) {
+			for (auto n : found) {
+				g_unlink(segment_path(n).c_str());
+			}
+			++next_segment;
+		}
+		idx = page_text_index{};
+		for (auto& page : live) {
+			idx.add(page);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock{mu};
+	index = std::move(idx);
+}
+
+// flush writes the pages indexed since the last flush as a new segment.
+void text_index::flush() {
+	if (unflushed.empty()) {
+		return;
+	}
+	if (write_segment(next_segment, unflushed)) {
+		++next_segment;
+	}
+	unflushed.clear();
+}
+
+// run loads the index and then indexes extracted page text until the index
+// is destroyed, writing the newly indexed pages to disk in batches.
+void text_index::run() {
+	load();
+
+	auto ready = [this] { return stopping || !queue.empty(); };
+	auto deadline = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock{mu};
+	for (;;) {
+		if (unflushed.empty()) {
+			cv.wait(lock, ready);
+		} else if (!cv.wait_until(lock, deadline, ready)) {
+			lock.unlock();
+			flush();
+			lock.lock();
+			continue;
+		}
+		if (queue.empty()) {
+			break;
+		}
+		auto text = std::move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+
+		// Only adding the page holds the lock shared with queries.
+		auto page = parse_page(text);
+		if (!page.terms.empty()) {
+			lock.lock();
+			index.add(page);
+			lock.unlock();
+			if (unflushed.empty()) {
+				deadline = std::chrono::steady_clock::now() + flush_interval;
+			}
+			unflushed.push_back(std::move(page));
+			if (unflushed.size() >= flush_pages) {
+				flush();
+			}
+		}
+		lock.lock();
+	}
+	lock.unlock();
+	flush();
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_TEXT_INDEX_H
+#define _VOLO_TEXT_INDEX_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <glib.h>
+
+#include <stall_monitor.h>
+#include <webkit.h>
+
+namespace volo {
+
+// indexed_page is a page as it is indexed: its URI, title, and the distinct
+// words (terms) of its text, sorted.
+struct indexed_page {
+	std::string uri;
+	std::string title;
+	std::vector<std::string> terms;
+};
+
+// text_match is a page found by a text_index query.
+struct text_match {
+	std::string uri;
+	std::string title;
+};
+
+// page_text_index is the in-memory inverted index over the text of every
+// indexed page.  Pages are numbered in the order they were indexed, and each
+// term's posting list is the increasing numbers of the pages containing it,
+// stored as varint encoded deltas.  A page indexed again replaces the older
+// copy, which is then skipped by queries.
+class page_text_index {
+private:
+	struct document {
+		std::string uri;
+		std::string title;
+		bool live;
+	};
+	struct posting_list {
+		std::string deltas;
+		uint32_t last{0};
+	};
+	std::vector<document> docs;
+	std::unordered_map<std::string, uint32_t> doc_by_uri;
+	// Sorted, so that a word of a query matches every term it prefixes.
+	std::map<std::string, posting_list> postings;
+	size_t dead{0};
+
+public:
+	void add(const indexed_page&);
+
+	// query finds the pages containing a term beginning with each word
+	// of text, most recently indexed first, appending up to limit to
+	// results.
+	void query(const std::string& text, size_t limit, std::vector<text_match>& results) const;
+
+	size_t size() const { return docs.size() - dead; }
+	size_t dead_pages() const { return dead; }
+
+	// live_pages returns every page which has not been replaced, with
+	// its terms, in the order they were indexed.
+	std::vector<indexed_page> live_pages() const;
+
+private:
+	std::vector<uint32_t> prefix_matches(const std::string& word) const;
+};
+
+// text_index indexes the text of loaded pages, so that pages can be found by
+// what they said.  Each page's text is extracted by its web process, then
+// split into terms and added to the index on a background thread, which also
+// keeps the index on disk.  The main thread only waits for the index's lock
+// while a single page is added.
+//
+// The index is stored in the user's data directory as segments, each holding
+// the pages indexed since the previous segment was written.  Segments are
+// loaded at startup, and merged into one (dropping replaced pages) when
+// there are too many or too much of them has been replaced.  A lock file in
+// the index directory keeps a second browser process from writing or merging
+// the segments of the first.
+class text_index {
+private:
+	page_text_index index;
+
+	std::string dir;
+	int lock_fd{-1};
+	std::thread thread;
+	std::mutex mu;
+	std::condition_variable cv;
+	// Extracted page text, waiting to be indexed.
+	std::deque<std::string> queue;
+	bool stopping{false};
+
+	// Used only by the background thread.
+	std::vector<indexed_page> unflushed;
+	unsigned int next_segment{0};
+
+public:
+	text_index() {}
+	~text_index();
+
+	text_index(const text_index&) = delete;
+	text_index& operator=(const text_index&) = delete;
+
+	// open begins loading the index and starts indexing pages.  It
+	// returns false if another browser process holds the index, in which
+	// case nothing is indexed or found.
+	bool open();
+
+	// page_loaded extracts the text of the page loaded by wv, to be indexed
+	// in the background.
+	void page_loaded(webkit::web_view&);
+
+	// query finds pages containing every word of text, as described by
+	// page_text_index::query.  Nothing is found until the index has been
+	// loaded.
+	void query(const std::string& text, size_t limit, std::vector<text_match>& results);
+
+private:
+	void run();
+	void load();
+	void flush();
+	bool write_segment(unsigned int n, const std::vector<indexed_page>&) const;
+	std::string segment_path(unsigned int n) const;
+	void on_text_extracted(GObject *, GAsyncResult *);
+
+	static void on_text_extracted(GObject *wv, GAsyncResult *result, gpointer i) {
+		slot_timer t{"text_index::on_text_extracted"};
+		static_cast<text_index *>(i)->on_text_extracted(wv, result);
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_TEXT_INDEX_H
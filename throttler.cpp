@@ -0,0 +1,260 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <throttler.h>
+
+using namespace volo;
+
+// CPU weight of the background cgroup, out of the default weight of 100.
+const char background_weight[] = "10";
+
+// Nice value of the threads of a background process.
+const int background_nice = 10;
+
+static const char cgroup_root[] = "/sys/fs/cgroup";
+
+// write_file writes s to an existing file, returning false on error.
+static bool write_file(const std::string& path, const std::string& s) {
+	auto fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return false;
+	}
+	auto ok = write(fd, s.data(), s.size()) == ssize_t(s.size());
+	close(fd);
+	return ok;
+}
+
+// read_file returns the contents of a small file, or an empty string on
+// error.
+static std::string read_file(const std::string& path) {
+	std::string s;
+	auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return s;
+	}
+	char buf[4096];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		s.append(buf, n);
+	}
+	close(fd);
+	return s;
+}
+
+// has_word returns whether the space separated list s includes word.
+static bool has_word(const std::string& s, const char *word) {
+	const auto len = strlen(word);
+	for (size_t pos = 0; (pos = s.find(word, pos)) != std::string::npos; pos += len) {
+		auto end = pos + len;
+		if ((pos == 0 || isspace(s[pos - 1])) && (end == s.size() || isspace(s[end]))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+process_throttler::process_throttler() {
+	if (setup_cgroup()) {
+		how = method::cgroup;
+		return;
+	}
+
+	// Threads may only be reniced back to zero if RLIMIT_NICE allows it
+	// (a limit of 20 - nice), or with privilege.
+	struct rlimit rl;
+	if (geteuid() == 0 || (getrlimit(RLIMIT_NICE, &rl) == 0 &&
+		(rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur >= 20))) {
+
+		how = method::nice;
+	}
+}
+
+process_throttler::~process_throttler() {
+	std::vector<pid_t> frozen;
+	for (auto& s : states) {
+		if (s.second == state::frozen) {
+			frozen.push_back(s.first);
+		}
+	}
+	for (auto pid : frozen) {
+		set_state(pid, state::normal);
+	}
+	if (how == method::cgroup) {
+		teardown_cgroup();
+	}
+}
+
+bool process_throttler::setup_cgroup() {
+	// Find this process's cgroup in the unified hierarchy.
+	auto self = read_file("/proc/self/cgroup");
+	auto line = self.find("0::");
+	if (line == std::string::npos || (line != 0 && self[line - 1] != '\n')) {
+		return false;
+	}
+	auto end = self.find('\n', line);
+	auto& base = base_group;
+	base = std::string{cgroup_root} + self.substr(line + 3, end - line - 3);
+	if (base.back() == '/') {
+		base.pop_back();
+	}
+	if (!has_word(read_file(base + "/cgroup.controllers"), "cpu") ||
+		access((base + "/cgroup.subtree_control").c_str(), W_OK) != 0) {
+
+		return false;
+	}
+
+	// A cgroup with processes cannot enable controllers for its
+	// children, so this process moves into a child cgroup of its own.
+	// Cgroups left by another instance are shared, and not removed.
+	normal_group = base + "/volo";
+	background_group = base + "/volo-background";
+	frozen_group = base + "/volo-frozen";
+	auto ok = true;
+	for (auto g : { &normal_group, &background_group, &frozen_group }) {
+		if (mkdir(g->c_str(), 0755) == 0) {
+			created_groups.push_back(*g);
+		} else if (errno != EEXIST) {
+			ok = false;
+		}
+	}
+	if (ok && !has_word(read_file(base + "/cgroup.subtree_control"), "cpu")) {
+		ok = move(getpid(), normal_group) &&
+			write_file(base + "/cgroup.subtree_control", "+cpu");
+		enabled_cpu = ok;
+	}
+	if (!ok || !write_file(background_group + "/cpu.weight", background_weight)) {
+		g_debug("volo: cgroup %s is not delegated", base.c_str());
+		teardown_cgroup();
+		return false;
+	}
+	can_freeze_cgroup = write_file(frozen_group + "/cgroup.freeze", "1");
+	return true;
+}
+
+// teardown_cgroup returns this process, and every process in the cgroups it
+// created, to its original cgroup, and removes those cgroups.
+void process_throttler::teardown_cgroup() {
+	// Processes may only be moved back once the original cgroup no
+	// longer distributes the cpu controller to its children.
+	if (enabled_cpu) {
+		write_file(base_group + "/cgroup.subtree_control", "-cpu");
+		enabled_cpu = false;
+	}
+	move(getpid(), base_group);
+	for (auto& g : created_groups) {
+		auto procs = read_file(g + "/cgroup.procs");
+		for (size_t pos = 0, end; pos < procs.size(); pos = end + 1) {
+			end = procs.find('\n', pos);
+			if (end == std::string::npos) {
+				end = procs.size();
+			}
+			auto pid = atoi(procs.c_str() + pos);
+			if (pid > 0) {
+				move(pid, base_group);
+			}
+		}
+		if (rmdir(g.c_str()) == -1) {
+			g_debug("volo: removing cgroup %s: %s", g.c_str(), g_strerror(errno));
+		}
+	}
+	created_groups.clear();
+}
+
+bool process_throttler::move(pid_t pid, const std::string& group) {
+	return write_file(group + "/cgroup.procs", std::to_string(pid));
+}
+
+// renice sets the nice value of every thread of a process, as Linux keeps a
+// nice value for each thread.
+bool process_throttler::renice(pid_t pid, int nice) {
+	auto task_dir = "/proc/" + std::to_string(pid) + "/task";
+	auto dir = opendir(task_dir.c_str());
+	if (!dir) {
+		return false;
+	}
+	auto ok = true;
+	while (auto ent = readdir(dir)) {
+		auto tid = atoi(ent->d_name);
+		if (tid > 0 && setpriority(PRIO_PROCESS, tid, nice) == -1 && errno != ESRCH) {
+			ok = false;
+		}
+	}
+	closedir(dir);
+	return ok;
+}
+
+void process_throttler::set_state(pid_t pid, state s) {
+	if (how == method::none || pid <= 0) {
+		return;
+	}
+	auto it = states.find(pid);
+	auto prev = it != states.end() ? it->second : state::normal;
+	if (prev == s) {
+		return;
+	}
+
+	auto ok = true;
+	if (how == method::cgroup) {
+		if (s == state::frozen && can_freeze_cgroup) {
+			ok = move(pid, frozen_group);
+		} else {
+			ok = move(pid, s == state::normal ? normal_group : background_group);
+		}
+	} else {
+		ok = renice(pid, s == state::normal ? 0 : background_nice);
+	}
+	if (s == state::frozen && (how == method::nice || !can_freeze_cgroup)) {
+		ok = ok && kill(pid, SIGSTOP) == 0;
+	} else if (prev == state::frozen && (how == method::nice || !can_freeze_cgroup)) {
+		kill(pid, SIGCONT);
+	}
+
+	if (!ok) {
+		g_debug("volo: throttling web process %d: %s", static_cast<int>(pid),
+			g_strerror(errno));
+		if (errno == ESRCH) {
+			states.erase(pid);
+		}
+		return;
+	}
+	states[pid] = s;
+}
+
+void process_throttler::forget(pid_t pid) {
+	auto it = states.find(pid);
+	if (it == states.end()) {
+		return;
+	}
+	if (it->second == state::frozen) {
+		set_state(pid, state::normal);
+	}
+	states.erase(pid);
+}
+
+const char * process_throttler::method_name() const {
+	switch (how) {
+	case method::cgroup:
+		return "cgroup";
+	case method::nice:
+		return "nice";
+	default:
+		return "none";
+	}
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_THROTTLER_H
+#define _VOLO_THROTTLER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace volo {
+
+// process_throttler lowers the CPU share of the web processes of hidden tabs,
+// and may freeze them entirely, so that they do not compete with the shown
+// tab.
+//
+// When the browser runs in a cgroup v2 hierarchy delegated to its user (such
+// as a systemd scope with Delegate=yes), the browser moves itself into a
+// child cgroup, and creates sibling cgroups for background processes, with
+// a low cpu.weight, and frozen processes.  Processes are throttled by moving
+// them between these cgroups.
+//
+// Otherwise, every thread of a background process is reniced and frozen
+// processes are stopped with SIGSTOP.  Renicing is only used when the
+// RLIMIT_NICE limit allows the priority of a shown tab to be restored.
+//
+// The cgroups are removed, and their processes moved back to the browser's
+// original cgroup, when the throttler is destroyed or if they cannot be set
+// up.
+class process_throttler {
+public:
+	enum class state {
+		normal,
+		background,
+		frozen,
+	};
+
+private:
+	enum class method {
+		none,
+		cgroup,
+		nice,
+	};
+	method how{method::none};
+	bool can_freeze_cgroup{false};
+	// The cgroup this process started in, and those it created (and
+	// removes when destroyed) below it.
+	std::string base_group;
+	std::vector<std::string> created_groups;
+	bool enabled_cpu{false};
+	std::string normal_group;
+	std::string background_group;
+	std::string frozen_group;
+	std::unordered_map<pid_t, state> states;
+
+public:
+	process_throttler();
+	~process_throttler();
+
+	process_throttler(const process_throttler&) = delete;
+	process_throttler& operator=(const process_throttler&) = delete;
+
+	// set_state throttles, freezes, or restores a process.
+	void set_state(pid_t, state);
+
+	// forget restores a process which is about to exit, so that it is
+	// not left frozen, and forgets its state.
+	void forget(pid_t);
+
+	// method_name describes how processes are throttled.
+	const char * method_name() const;
+
+private:
+	bool setup_cgroup();
+	void teardown_cgroup();
+	bool move(pid_t, const std::string& group);
+	bool renice(pid_t, int);
+};
+
+} // namespace volo
+
+#endif // _VOLO_THROTTLER_H
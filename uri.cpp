@@ -0,0 +1,111 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include <uri.h>
+
+using namespace volo;
+
+bool volo::uri_origin(const std::string& uri, std::string& origin, std::string& host) {
+	auto sep = uri.find("://");
+	if (sep == std::string::npos) {
+		return false;
+	}
+	auto start = sep + 3;
+	auto end = uri.find_first_of("/?#", start);
+	if (end == std::string::npos) {
+		end = uri.size();
+	}
+	auto at = uri.rfind('@', end);
+	if (at != std::string::npos && at >= start) {
+		start = at + 1;
+	}
+	auto port = uri.find(':', start);
+	host = uri.substr(start, std::min(port, end) - start);
+	if (host.empty()) {
+		return false;
+	}
+	std::transform(host.begin(), host.end(), host.begin(), [](unsigned char c) { return tolower(c); });
+	origin = uri.substr(0, sep + 3) + uri.substr(start, end - start);
+	return true;
+}
+
+std::string volo::uri_host(const std::string& uri) {
+	std::string origin, host;
+	if (!uri_origin(uri, origin, host)) {
+		host.clear();
+	}
+	return host;
+}
+
+bool volo::uri_host_span(const char *uri, const char *& host, size_t& len) {
+	auto sep = strstr(uri, "://");
+	if (!sep) {
+		return false;
+	}
+	auto start = sep + 3;
+	auto end = start + strcspn(start, "/?#");
+	for (auto p = end; p != start; --p) {
+		if (p[-1] == '@') {
+			start = p;
+			break;
+		}
+	}
+	auto host_end = start;
+	if (*start == '[') {
+		// An IPv6 address, which contains colons.
+		host_end = static_cast<const char *>(memchr(start, ']', end - start));
+		host_end = host_end ? host_end + 1 : end;
+	} else {
+		host_end = static_cast<const char *>(memchr(start, ':', end - start));
+		host_end = host_end ? host_end : end;
+	}
+	host = start;
+	len = host_end - start;
+	return len != 0;
+}
+
+// Second level labels which, under a country code top level domain, are
+// taken to be part of the public suffix.
+static const char *const generic_second_levels[] = {
+	"ac", "co", "com", "edu", "go", "gov", "ne", "net", "or", "org",
+};
+
+size_t volo::registrable_domain(const char *host, size_t len) {
+	if (host[0] == '[' || std::all_of(host, host + len,
+		[](char c) { return isdigit(static_cast<unsigned char>(c)) || c == '.'; })) {
+
+		return 0;
+	}
+
+	// A trailing dot (of a fully qualified name) is ignored.
+	auto end = len;
+	if (end && host[end - 1] == '.') {
+		--end;
+	}
+	// label_start returns the start of the label ending at pos.
+	auto label_start = [host](size_t pos) {
+		while (pos && host[pos - 1] != '.') {
+			--pos;
+		}
+		return pos;
+	};
+	auto tld = label_start(end);
+	if (!tld) {
+		return 0;
+	}
+	auto sld = label_start(tld - 1);
+	if (!sld || end - tld != 2) {
+		return sld;
+	}
+	auto sld_len = tld - 1 - sld;
+	auto generic = std::any_of(std::begin(generic_second_levels),
+		std::end(generic_second_levels), [&](const char *label) {
+			return strlen(label) == sld_len && !strncasecmp(label, host + sld, sld_len);
+		});
+	return generic ? label_start(sld - 1) : sld;
+}
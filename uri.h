@@ -0,0 +1,33 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_URI_H
+#define _VOLO_URI_H
+
+#include <string>
+
+namespace volo {
+
+// uri_origin splits an absolute URI into its origin (scheme and authority)
+// and lowercased host.  It returns false if uri has no host.
+bool uri_origin(const std::string& uri, std::string& origin, std::string& host);
+
+// uri_host returns the lowercased host of an absolute URI, or an empty string
+// if it has none.
+std::string uri_host(const std::string& uri);
+
+// uri_host_span finds the host of an absolute URI without copying it,
+// returning false if it has none.  The host is not lowercased.
+bool uri_host_span(const char *uri, const char *& host, size_t& len);
+
+// registrable_domain returns the offset in host of its registrable domain:
+// the public suffix and one label before it.  Public suffixes are
+// approximated as the last label, or the last two when the top level
+// domain is a country code preceded by a generic second level label (such
+// as "co.uk").  IP addresses are returned whole.
+size_t registrable_domain(const char *host, size_t len);
+
+} // namespace volo
+
+#endif // _VOLO_URI_H
@@ -4,6 +4,7 @@
 
 #include <array>
 
+#include <stall_monitor.h>
 #include <uri_entry.h>
 
 enum {
@@ -44,6 +45,27 @@ void init(VoloURIEntry& uri_entry) {
 	uri_entry.editing = false;
 	uri_entry.refresh_pressed = false;
 
+	// Suggestions are chosen by the owner of the entry, so every row of
+	// the model matches.
+	using match_func = gboolean (*)(GtkEntryCompletion *, const char *, GtkTreeIter *, gpointer);
+	auto completion = gtk_entry_completion_new();
+	uri_entry.suggestions = gtk_list_store_new(2, G_TYPE_STRING, G_TYPE_STRING);
+	gtk_entry_completion_set_model(completion,
+		reinterpret_cast<GtkTreeModel *>(uri_entry.suggestions));
+	g_object_unref(uri_entry.suggestions);
+	gtk_entry_completion_set_text_column(completion, 0);
+	gtk_entry_completion_set_match_func(completion,
+		match_func([](GtkEntryCompletion *, const char *, GtkTreeIter *, gpointer) {
+			return gboolean{TRUE};
+		}), nullptr, nullptr);
+	auto title_cell = gtk_cell_renderer_text_new();
+	g_object_set(title_cell, "ellipsize", PANGO_ELLIPSIZE_END, nullptr);
+	auto layout = reinterpret_cast<GtkCellLayout *>(completion);
+	gtk_cell_layout_pack_end(layout, title_cell, true);
+	gtk_cell_layout_add_attribute(layout, title_cell, "text", 1);
+	gtk_entry_set_completion(&uri_entry, completion);
+	g_object_unref(completion);
+
 	using icon_press_cb = void (*)(GtkEntry *, GtkEntryIconPosition, GdkEvent *, gpointer);
 	g_signal_connect(&uri_entry, "icon-press",
 		G_CALLBACK(icon_press_cb(&VoloURIEntry::icon_press)), nullptr);
@@ -67,6 +89,18 @@ void VoloURIEntry::set_uri(const char *uri) {
 	}
 }
 
+void VoloURIEntry::clear_suggestions() {
+	gtk_list_store_clear(suggestions);
+}
+
+void VoloURIEntry::add_suggestion(const char *uri, const char *title) {
+	gtk_list_store_insert_with_values(suggestions, nullptr, -1, 0, uri, 1, title, -1);
+}
+
+void VoloURIEntry::show_suggestions() {
+	gtk_entry_completion_complete(gtk_entry_get_completion(this));
+}
+
 gtk::entry::class_type * VoloURIEntry::parent_vtable() {
 	return reinterpret_cast<gtk::entry::class_type *>(
 		volo_uri_entry_parent_class
@@ -78,6 +112,7 @@ gtk::entry::class_type * VoloURIEntry::parent_vtable() {
 // init function above to apply the override.
 
 gboolean VoloURIEntry::button_release(GtkWidget *w, GdkEventButton *ev) {
+	volo::slot_timer t{"uri_entry::button_release"};
 	return reinterpret_cast<VoloURIEntry *>(w)->button_release(*ev);
 }
 
@@ -107,6 +142,7 @@ bool VoloURIEntry::button_release(GdkEventButton& ev) {
 }
 
 gboolean VoloURIEntry::focus_out_event(GtkWidget *w, GdkEventFocus *f) {
+	volo::slot_timer t{"uri_entry::focus_out_event"};
 	return reinterpret_cast<VoloURIEntry *>(w)->focus_out_event(*f);
 }
 
@@ -121,6 +157,7 @@ bool VoloURIEntry::focus_out_event(GdkEventFocus& f) {
 void VoloURIEntry::icon_press(GtkEntry *e, GtkEntryIconPosition icon_pos,
 	GdkEvent *ev, gpointer user_data) {
 
+	volo::slot_timer t{"uri_entry::icon_press"};
 	reinterpret_cast<VoloURIEntry *>(e)->icon_press(icon_pos, *ev, user_data);
 }
 
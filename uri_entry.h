@@ -24,6 +24,9 @@ class VoloURIEntry : public gtk::entry {
 private:
 	bool editing;
 	bool refresh_pressed;
+	// URIs and titles offered for completion, owned by the entry's
+	// completion.
+	GtkListStore *suggestions;
 
 	static gtk::entry::class_type* parent_vtable();
 
@@ -36,6 +39,13 @@ public:
 	void set_uri(const std::string& uri);
 	void set_uri(const char *uri);
 
+	// Suggestions offered in the entry's completion popup.  Suggestions
+	// are not filtered by the entry; show_suggestions displays all added
+	// suggestions, in order.
+	void clear_suggestions();
+	void add_suggestion(const char *uri, const char *title);
+	void show_suggestions();
+
 	// Overridden signal vfuncs.  A static overload is used to allow
 	// assignment to a parent class, and simply calls the non-static
 	// member function.
@@ -0,0 +1,88 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+
+#include <uri_reader.h>
+#include <volo.h>
+
+using namespace volo;
+
+uri_reader::uri_reader(int fd, browser& b) : fd{fd}, b(b) {}
+
+uri_reader::~uri_reader() {
+	close(fd);
+}
+
+void uri_reader::watch(int fd, browser& b) {
+	auto reader = new uri_reader{fd, b};
+	g_unix_fd_add_full(G_PRIORITY_DEFAULT_IDLE, fd,
+		static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR),
+		on_readable, reader, on_source_destroy);
+}
+
+bool uri_reader::on_readable() {
+	char chunk[64 * 1024];
+
+	// The descriptor is left blocking, as its flags are shared with any
+	// other process reading it (a parent shell, for stdin).  The main
+	// loop found it readable, so one read returns what is available
+	// without blocking, unless another reader took the input first.
+	auto p = pollfd{fd, POLLIN, 0};
+	if (poll(&p, 1, 0) == 0) {
+		return G_SOURCE_CONTINUE;
+	}
+	auto n = read(fd, chunk, sizeof(chunk));
+	if (n == -1) {
+		if (errno == EAGAIN || errno == EINTR) {
+			return G_SOURCE_CONTINUE;
+		}
+		g_warning("uri_reader: read: %s", g_strerror(errno));
+		queue_lines(true);
+		return G_SOURCE_REMOVE;
+	}
+	if (n == 0) {
+		queue_lines(true);
+		return G_SOURCE_REMOVE;
+	}
+
+	buf.append(chunk, n);
+	queue_lines(false);
+	return G_SOURCE_CONTINUE;
+}
+
+void uri_reader::queue_lines(bool eof) {
+	std::string::size_type start = 0;
+	for (;;) {
+		auto end = buf.find('\n', start);
+		if (end == std::string::npos) {
+			if (!eof) {
+				break;
+			}
+			end = buf.size();
+		}
+
+		auto line = buf.substr(start, end - start);
+		while (!line.empty() && isspace(static_cast<unsigned char>(line.back()))) {
+			line.pop_back();
+		}
+		auto first = line.find_first_not_of(" \t");
+		if (first != std::string::npos && line[first] != '#') {
+			b.queue_uri(line.substr(first));
+		}
+
+		start = end + 1;
+		if (start >= buf.size()) {
+			break;
+		}
+	}
+	buf.erase(0, std::min(start, buf.size()));
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2014 Josh Rickmar.
+// Use of this source code is governed by an ISC
+// license that can be found in the LICENSE file.
+
+#ifndef _VOLO_URI_READER_H
+#define _VOLO_URI_READER_H
+
+#include <string>
+
+#include <glib.h>
+
+#include <stall_monitor.h>
+
+namespace volo {
+
+class browser;
+
+// uri_reader reads newline-separated URIs from a file descriptor whenever
+// the main loop finds it readable, and queues a tab in the browser for each
+// URI read.  Blank lines and lines beginning with '#' are ignored.  Readers
+// are owned by their main loop source, and close the descriptor once EOF is
+// reached or a read fails.
+class uri_reader {
+private:
+	int fd;
+	browser& b;
+	std::string buf;
+
+	uri_reader(int, browser&);
+
+public:
+	~uri_reader();
+
+	// watch begins reading URIs from fd at idle priority, so that long
+	// lists are streamed in without delaying event processing.
+	static void watch(int fd, browser&);
+
+private:
+	bool on_readable();
+	void queue_lines(bool eof);
+
+	static gboolean on_readable(int, GIOCondition, gpointer reader) {
+		slot_timer t{"uri_reader::on_readable"};
+		return static_cast<uri_reader *>(reader)->on_readable();
+	}
+	static void on_source_destroy(gpointer reader) {
+		delete static_cast<uri_reader *>(reader);
+	}
+};
+
+} // namespace volo
+
+#endif // _VOLO_URI_READER_H
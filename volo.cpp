@@ -3,13 +3,54 @@
 // license that can be found in the LICENSE file.
 
 #include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
 #include <string>
 
+#include <err.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+
 #include <volo.h>
+#include <content_blocker.h>
+#include <instance.h>
+#include <uri.h>
+#include <uri_reader.h>
 #include <gdk/gdkkeysyms.h>
 
 using namespace volo;
 
+// Interval, in seconds, between checks for idle tabs to discard.
+const unsigned int discard_check_interval = 30;
+
+// Time, in microseconds, that each idle callback may spend opening queued
+// tabs before returning to the main loop.
+const gint64 uri_queue_budget = 4000;
+
+// Number of history suggestions offered by the URI entry.
+const size_t max_suggestions = 10;
+
+// Number of those suggestions which may instead be pages found by their
+// text.
+const size_t max_text_suggestions = 3;
+
+// Interval, in seconds, between samples of each web process's memory and
+// CPU use.
+const unsigned int process_sample_interval = 10;
+
+// Time, in milliseconds, the URI entry must be left unchanged before the
+// network is prepared for the likely destination.
+const unsigned int speculation_delay = 150;
+
+// Time, in milliseconds, the page search text must be left unchanged before
+// every tab is searched.  The search entry already waits briefly after each
+// change, which is enough for a search of just the shown tab.
+const unsigned int all_tabs_search_delay = 300;
+
 const std::array<std::string, 2> recognized_uri_schemes = { {
 	"http://",
 	"https://",
@@ -30,21 +71,58 @@ void guess_uri(std::string& uri) {
 	uri = "http://" + uri;
 }
 
+// guess_scheme adds a guessed scheme to a non-blank URI which does not
+// explicitly name one, such as those given on the command line.
+static void guess_scheme(std::string& uri) {
+	if (!uri.empty() && uri.find("://") == std::string::npos &&
+		!has_prefix(uri, std::string{"about:"})) {
+
+		guess_uri(uri);
+	}
+}
+
+// URI of a blank page.  A web_view which has loaded nothing has an empty URI.
+static const char blank_uri[] = "about:blank";
+
+// is_blank returns whether uri is that of a blank page, such as a new tab.
+static bool is_blank(const char *uri) {
+	return !*uri || !strcmp(uri, blank_uri);
+}
+
 search_bar::search_bar() :
 	bar{gtk::make_sunk<gtk::search_bar>()},
-	entry{gtk::make_sunk<gtk::search_entry>()} {
+	box{gtk::make_sunk<gtk::box>(GTK_ORIENTATION_HORIZONTAL, 6)},
+	entry{gtk::make_sunk<gtk::search_entry>()},
+	matches{gtk::make_sunk<gtk::label>()} {
 
 	entry->set_size_request(200, -1);
-	bar->add(*entry);
+	box->add(*entry);
+	box->add(*matches);
+	bar->add(*box);
 	bar->set_show_close_button(true);
 }
 
-void search_bar::begin_searching(webkit::web_view& wv) {
+void search_bar::begin_searching(webkit::web_view& wv, bool all) {
 	controller = wv.get_find_controller();
+	all_tabs = all;
 	bar->set_search_mode(true);
 }
 
-browser::browser(const std::vector<const char *>& uris) :
+bool search_bar::is_searching() const {
+	return bar->get_search_mode() && !text.empty();
+}
+
+// match_count_text describes a number of matches, which WebKit reports as
+// G_MAXUINT once there are more than the maximum.
+static std::string match_count_text(unsigned int count, unsigned int max) {
+	if (count > max) {
+		return "more than " + std::to_string(max);
+	}
+	return std::to_string(count);
+}
+
+browser::browser(const std::vector<const char *>& uris, session_journal *journal,
+	const web_view_options& view_options) :
 	window{gtk::make_sunk<gtk::window>()},
 	navbar{gtk::make_sunk<gtk::header_bar>()},
 	histnav{gtk::make_sunk<gtk::box>()},
@@ -52,7 +130,10 @@ browser::browser(const std::vector<const char *>& uris) :
 	fwd{gtk::make_sunk<gtk::button>("go-next", GTK_ICON_SIZE_BUTTON)},
 	new_tab{gtk::make_sunk<gtk::button>("add", GTK_ICON_SIZE_BUTTON)},
 	nav_entry{gtk::make_sunk<uri_entry>()},
-	nb{gtk::make_sunk<gtk::notebook>()} {
+	nb{gtk::make_sunk<gtk::notebook>()},
+	journal{journal},
+	view_options{view_options},
+	spec{view_options.context} {
 
 	back->set_can_focus(false);
 	fwd->set_can_focus(false);
@@ -73,6 +154,9 @@ browser::browser(const std::vector<const char *>& uris) :
 	navbar->set_show_close_button(true);
 
 	auto num_uris = uris.size();
+	if (journal) {
+		num_uris += journal->restored_tabs().size();
+	}
 	nb->set_show_tabs(num_uris > 1);
 	nb->set_vexpand(true);
 
@@ -84,39 +168,137 @@ browser::browser(const std::vector<const char *>& uris) :
 	window->set_titlebar(*navbar);
 	nb->set_scrollable(true);
 	grid->add(*nb);
+	grid->add(overview->widget());
 
 	grid->add(*page_search.bar);
 
 	tabs.reserve(num_uris);
-	for (auto& uri : uris) {
-		open_new_tab(uri);
+	slot_handle first_tab;
+	if (journal && !journal->restored_tabs().empty()) {
+		// Restore the previous session.  Blank URIs from the
+		// session argument are not opened in addition to it.
+		auto& restored = journal->restored_tabs();
+		first_tab = open_tab(restored.front().uri.c_str(), restored.front().id);
+		for (auto it = restored.cbegin() + 1; it != restored.cend(); ++it) {
+			queue_tab(it->uri, it->id);
+		}
+		journal->clear_restored();
+		for (auto uri : uris) {
+			if (*uri) {
+				queue_uri(uri);
+			}
+		}
+	} else {
+		auto first_uri = std::string{uris.front()};
+		guess_scheme(first_uri);
+		first_tab = open_tab(first_uri.c_str(), 0);
+		for (auto it = uris.cbegin() + 1; it != uris.cend(); ++it) {
+			queue_uri(*it);
+		}
 	}
 
 	nav_entry->connect_activate(*this, on_nav_entry_activate);
+	nav_entry->connect_changed(*this, on_nav_entry_changed);
 	nb->connect_switch_page(*this, on_notebook_switch_page);
 	nb->connect_page_added(*this, on_notebook_page_added);
 	nb->connect_page_removed(*this, on_notebook_page_removed);
+	nb->connect_page_reordered(*this, on_notebook_page_reordered);
+	back->connect_clicked(*this, on_back_button_clicked);
+	fwd->connect_clicked(*this, on_fwd_button_clicked);
+	nav_entry->connect_refresh_clicked(*this, on_nav_entry_refresh_clicked);
+	page_search.entry->connect_search_changed(*this, on_page_search_changed);
 	new_tab->connect_clicked(*this, on_new_tab_clicked);
 	window->connect_key_press_event(*this, on_window_key_press_event);
 	window->connect_destroy(*this, on_window_destroy);
+	overview->set_activated([this](size_t n) {
+		auto tab = tabs.get(overview_tabs[n]);
+		hide_overview();
+		if (tab) {
+			nb->set_current_page(nb->page_num(*tab->page));
+		}
+	});
 
-	show_webview(0, *tabs.front().wv);
+	show_webview(first_tab, materialize_tab(first_tab));
+
+	gtk::timeout_add_seconds(discard_check_interval, *this, on_discard_timeout);
+	gtk::timeout_add_seconds(process_sample_interval, *this, on_process_timeout);
 
 	window->add(*grid);
 	window->show_all();
+	stall_monitor::watch_frames(GTK_WIDGET(window->ptr()));
 }
 
 void browser::on_nav_entry_activate(uri_entry& entry) {
 	auto uri = static_cast<std::string>(nav_entry->get_text());
 	guess_uri(uri);
+	if (speculation_source) {
+		g_source_remove(speculation_source);
+		speculation_source = 0;
+	}
+	spec.navigated(uri.c_str());
 	visable_tab.web_view->load_uri(uri);
 	visable_tab.web_view->grab_focus();
 }
 
+void browser::on_nav_entry_changed(uri_entry& entry) {
+	// Changes made by set_uri, rather than the user, are ignored.
+	if (!entry.has_focus()) {
+		return;
+	}
+
+	std::vector<const history_entry *> results;
+	std::vector<text_match> text_results;
+	if (page_texts) {
+		page_texts->query(entry.get_text(), max_text_suggestions, text_results);
+	}
+	if (hist) {
+		hist->query(entry.get_text(), max_suggestions - text_results.size(), results);
+	}
+	if (hist || page_texts) {
+		entry.clear_suggestions();
+		for (auto e : results) {
+			entry.add_suggestion(e->uri.c_str(), e->title.c_str());
+		}
+		// Pages found by their text follow those found by URI or
+		// title.
+		for (auto& m : text_results) {
+			auto dup = std::any_of(results.cbegin(), results.cend(),
+				[&m](const history_entry *e) { return e->uri == m.uri; });
+			if (!dup) {
+				entry.add_suggestion(m.uri.c_str(), m.title.c_str());
+			}
+		}
+		entry.show_suggestions();
+	}
+
+	speculative_text = entry.get_text();
+	speculative_top = results.empty() ? "" : results.front()->uri;
+	if (speculation_source) {
+		g_source_remove(speculation_source);
+	}
+	speculation_source = gtk::timeout_add(speculation_delay, *this, on_speculation_timeout);
+}
+
+bool browser::on_speculation_timeout() {
+	speculation_source = 0;
+	auto uri = speculative_text;
+	guess_uri(uri);
+	// The spare web_view shows an empty document, and opens connections
+	// without disturbing any tab.
+	spec.speculate(speculative_text, uri, speculative_top, spare_view.get());
+	return G_SOURCE_REMOVE;
+}
+
 void browser::on_notebook_switch_page(gtk::notebook& notebook, gtk::widget& page,
 	unsigned int page_num) {
 
-	switch_page(page_num);
+	if (closing) {
+		return;
+	}
+	auto it = tab_by_page.find(page.ptr());
+	if (it != tab_by_page.end()) {
+		switch_page(it->second);
+	}
 }
 
 void browser::on_notebook_page_added(gtk::notebook& notebook, gtk::widget& child,
@@ -140,7 +322,42 @@ bool browser::on_window_key_press_event(gtk::window& window, GdkEventKey& ev) {
 	auto kv = ev.keyval;
 	auto state = ev.state;
 
+	// The tab overview takes the keys used to choose a tab while shown.
+	if (overview->is_shown()) {
+		if (kv == GDK_KEY_Escape) {
+			hide_overview();
+			return true;
+		}
+		// While typing a search of every tab, the keys which edit
+		// the search text are left to the search entry.
+		auto typing = page_search.entry->has_focus() && kv != GDK_KEY_Up &&
+			kv != GDK_KEY_Down && kv != GDK_KEY_Return && kv != GDK_KEY_KP_Enter;
+		if (!typing && overview->key_press(ev)) {
+			return true;
+		}
+	}
+
 	if (state == (GDK_CONTROL_MASK|GDK_SHIFT_MASK)) {
+		if (kv == GDK_KEY_A) {
+			if (overview->is_shown()) {
+				hide_overview();
+			} else {
+				show_overview();
+			}
+			return true;
+		}
+		if (kv == GDK_KEY_E) {
+			export_har();
+			return true;
+		}
+		if (kv == GDK_KEY_F) {
+			begin_page_search(true);
+			return true;
+		}
+		if (kv == GDK_KEY_L) {
+			toggle_lightweight();
+			return true;
+		}
 		if (kv == GDK_KEY_ISO_Left_Tab) {
 			auto n = nb->get_current_page();
 			if (n == 0) {
@@ -148,7 +365,6 @@ bool browser::on_window_key_press_event(gtk::window& window, GdkEventKey& ev) {
 			} else {
 				--n;
 			}
-			switch_page(n);
 			nb->set_current_page(n);
 			return true;
 		}
@@ -158,7 +374,6 @@ bool browser::on_window_key_press_event(gtk::window& window, GdkEventKey& ev) {
 			if (++n == tabs.size()) {
 				n = 0;
 			}
-			switch_page(n);
 			nb->set_current_page(n);
 			return true;
 		}
@@ -181,31 +396,25 @@ bool browser::on_window_key_press_event(gtk::window& window, GdkEventKey& ev) {
 			nb->set_current_page(n);
 			return true;
 		} else if (kv == GDK_KEY_w) {
-			tabs.erase(tabs.cbegin() + visable_tab.tab_index);
-			if (tabs.size() == 0) {
-				window.destroy();
-			}
+			close_tab(visable_tab.tab);
 			return true;
 		} else if (kv == GDK_KEY_q) {
-			tabs.clear();
 			window.destroy();
 			return true;
 		} else if (kv == GDK_KEY_r) {
 			visable_tab.web_view->reload();
 			return true;
 		} else if (kv == GDK_KEY_f) {
-			page_search.begin_searching(*visable_tab.web_view);
+			begin_page_search(false);
 			return true;
 		} else if (kv >= GDK_KEY_1 && kv <= GDK_KEY_8) {
 			auto n = kv - GDK_KEY_1;
 			if (tabs.size() > n) {
-				switch_page(n);
 				nb->set_current_page(n);
 			}
 			return true;
 		} else if (kv == GDK_KEY_9) {
 			auto n = tabs.size() - 1;
-			switch_page(n);
 			nb->set_current_page(n);
 			return true;
 		}
@@ -215,13 +424,15 @@ bool browser::on_window_key_press_event(gtk::window& window, GdkEventKey& ev) {
 }
 
 void browser::on_window_destroy(gtk::window& w) {
+	closing = true;
 	gtk_main_quit();
 }
 
 browser_tab::browser_tab(const char *uri) :
-	wv{gtk::make_sunk<webkit::web_view>(uri)},
-	tab_title{gtk::make_sunk<gtk::label>("New tab")},
-	tab_close{gtk::make_sunk<gtk::button>("window-close", GTK_ICON_SIZE_BUTTON)} {
+	page{gtk::make_sunk<gtk::box>()},
+	tab_title{gtk::make_sunk<gtk::label>(*uri ? uri : "New tab")},
+	tab_close{gtk::make_sunk<gtk::button>("window-close", GTK_ICON_SIZE_BUTTON)},
+	uri{uri} {
 
 	tab_title->set_can_focus(false);
 	tab_title->set_hexpand(true);
@@ -229,18 +440,105 @@ browser_tab::browser_tab(const char *uri) :
 	tab_title->set_size_request(50, -1);
 }
 
+webkit::web_view& browser_tab::materialize(gtk::unique_ptr<webkit::web_view> view) {
+	if (wv) {
+		return *wv;
+	}
+
+	wv = std::move(view);
+	if (state) {
+		// Restore the discarded session and load its current item,
+		// falling back to the saved URI if the list is empty.
+		wv->restore_session_state(*state);
+		auto item = webkit_back_forward_list_get_current_item(
+			wv->get_back_forward_list());
+		if (item) {
+			wv->go_to_back_forward_list_item(*item);
+		} else {
+			wv->load_uri(uri);
+		}
+		state.reset();
+	} else {
+		first_commit = true;
+		if (!uri.empty()) {
+			wv->load_uri(uri);
+		}
+	}
+	std::string{}.swap(uri);
+	resources = std::make_unique<resource_log>();
+	page->pack_start(*wv);
+	wv->show_all();
+	return *wv;
+}
+
+void browser_tab::discard() {
+	if (!wv) {
+		return;
+	}
+
+	// The title is left in the tab label, which outlives the web_view.
+	state = wv->get_session_state();
+	uri = wv->get_uri();
+	wv.reset();
+	resources.reset();
+}
+
+// on_web_view_decide_policy applies the settings of the site a tab is about
+// to navigate to, or be redirected to, before the request is sent, so that
+// rules such as user-agent apply to the request for the page itself.
+// Navigations of subframes keep the settings of the page.  The decision is
+// left to WebKit.
+bool browser::on_web_view_decide_policy(webkit::web_view& wv, WebKitPolicyDecision& decision,
+	WebKitPolicyDecisionType type) {
+
+	auto tab = find_tab(wv);
+	if (type != WEBKIT_POLICY_DECISION_TYPE_NAVIGATION_ACTION || !tab) {
+		return false;
+	}
+	auto action = webkit_navigation_policy_decision_get_navigation_action(
+		WEBKIT_NAVIGATION_POLICY_DECISION(&decision));
+	if (webkit_navigation_action_get_frame_name(action)) {
+		return false;
+	}
+	apply_settings(*tab, wv, webkit_uri_request_get_uri(
+		webkit_navigation_action_get_request(action)));
+	return false;
+}
+
 void browser::on_web_view_load_changed(webkit::web_view& wv, WebKitLoadEvent load_event) {
 	GTlsCertificate *certificate = nullptr;
 	GTlsCertificateFlags errors{};
 
+	// Every load event is timestamped in the tab's load timing, which
+	// is recorded once the load finishes.
+	const auto now = g_get_monotonic_time();
+	auto tab = find_tab(wv);
+	load_timing unused;
+	auto& timing = tab ? tab->load : unused;
+
 	switch (load_event) {
 	case WEBKIT_LOAD_STARTED:
+		timing = load_timing{};
+		timing.started = now;
 		break;
 
 	case WEBKIT_LOAD_REDIRECTED:
+		timing.redirected = now;
+		++timing.redirects;
 		break;
 
 	case WEBKIT_LOAD_COMMITTED:
+		timing.committed = now;
+		if (tab && tab->first_commit) {
+			tab->first_commit = false;
+			if (wv.can_go_back()) {
+				g_warning("volo: the first page of a new tab has a previous "
+					"history item");
+			}
+		}
+		if (hist) {
+			hist->record_visit(wv.get_uri());
+		}
 		if (wv.get_tls_info(certificate, errors)) {
 			// TODO: Display certificate details.
 		} else {
@@ -249,76 +547,673 @@ void browser::on_web_view_load_changed(webkit::web_view& wv, WebKitLoadEvent loa
 		break;
 
 	case WEBKIT_LOAD_FINISHED:
+		timing.finished = now;
+		if (loads) {
+			loads->record(uri_host(wv.get_uri()), timing);
+		}
+		if (cache) {
+			cache->page_loaded(wv);
+		}
+		if (page_texts) {
+			page_texts->page_loaded(wv);
+		}
 		break;
 	}
 }
 
+void browser::on_web_view_resource_load_started(webkit::web_view& wv,
+	WebKitWebResource& resource, WebKitURIRequest& request) {
+
+	auto tab = find_tab(wv);
+	if (tab && tab->resources) {
+		tab->resources->resource_started(resource, request,
+			&resource == wv.get_main_resource());
+	}
+}
+
+// export_har writes the resources loaded by the shown page as an HTTP
+// Archive to the downloads directory, named for the page's host and the
+// current time.
+void browser::export_har() {
+	auto tab = tabs.get(visable_tab.tab);
+	if (!tab || !tab->resources) {
+		return;
+	}
+	auto host = uri_host(visable_tab.web_view->get_uri());
+	char stamp[32];
+	auto t = time(nullptr);
+	struct tm tm;
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime_r(&t, &tm));
+	auto name = (host.empty() ? std::string{"page"} : host) + "-" + stamp + ".har";
+
+	auto dir = g_get_user_special_dir(G_USER_DIRECTORY_DOWNLOAD);
+	auto path = g_build_filename(dir ? dir : g_get_home_dir(), name.c_str(), nullptr);
+	if (tab->resources->write_har(path, visable_tab.web_view->get_title(), tab->load)) {
+		g_message("volo: wrote %s", path);
+	}
+	g_free(path);
+}
+
 void browser::on_web_view_notify_title(webkit::web_view& wv, GParamSpec& param_spec) {
 	auto title = wv.get_title();
+	if (hist) {
+		hist->set_title(wv.get_uri(), title);
+	}
 
-	// Common case: If the webview emitting the notify::title signal is the
-	// currently shown tab, set both the tab title label and the window title
-	// with the webview title.
+	// Set the tab title label with the webview title, and if the webview
+	// is in the currently shown tab, the window title as well.  The
+	// window title is not modified for a webview in an nonvisable tab.
+	if (auto tab = find_tab(wv)) {
+		tab->tab_title->set_text(title);
+	}
 	if (visable_tab.web_view == &wv) {
 		window->set_title(title);
-		tabs[visable_tab.tab_index].tab_title->set_text(title);
-		return;
 	}
+}
+
+void browser::set_max_find_matches(unsigned int max) {
+	page_search.max_matches = max;
+}
 
-	// If the notified webview is not the currently-shown tab, we must
-	// search for the correct tab title to modify.  The window title is
-	// not modified for a webview in an nonvisable tab.
-	auto tab = std::find_if(std::cbegin(tabs), std::cend(tabs),
-		[&wv](auto& t) { return t.wv.get() == &wv; });
-	tab->tab_title->set_text(title);
+// begin_page_search shows the search bar, searching the shown tab or every
+// tab for any text already entered.
+void browser::begin_page_search(bool all_tabs) {
+	page_search.begin_searching(*visable_tab.web_view, all_tabs);
+	search_pages();
 }
 
 void browser::on_page_search_changed(gtk::search_entry& entry) {
-	auto text = entry.get_text();
-	page_search.controller->search(text);
+	if (page_search.delay_source) {
+		g_source_remove(page_search.delay_source);
+		page_search.delay_source = 0;
+	}
+	if (page_search.all_tabs) {
+		page_search.delay_source = gtk::timeout_add(all_tabs_search_delay, *this,
+			on_page_search_timeout);
+		return;
+	}
+	search_pages();
+}
+
+bool browser::on_page_search_timeout() {
+	page_search.delay_source = 0;
+	search_pages();
+	return G_SOURCE_REMOVE;
+}
+
+// search_pages searches the shown tab for the search entry's text, and when
+// searching every tab, counts its matches in every materialized tab.  Each
+// web process counts its own matches, so the tabs are searched in parallel.
+// Tabs whose processes are frozen are counted once they are thawed.
+void browser::search_pages() {
+	page_search.text = page_search.entry->get_text();
+	page_search.counts.clear();
+	if (page_search.text.empty()) {
+		for (auto& tab : tabs) {
+			if (tab.wv) {
+				tab.wv->get_find_controller()->search_finish();
+			}
+		}
+		update_search_status();
+		if (overview->is_shown()) {
+			update_overview();
+		}
+		return;
+	}
+
+	search_page(*visable_tab.web_view);
+	if (page_search.all_tabs) {
+		for (auto& tab : tabs) {
+			if (tab.wv && tab.wv.get() != visable_tab.web_view) {
+				tab.wv->get_find_controller()->count_matches(
+					page_search.text.c_str(),
+					webkit::find_controller::default_find_options,
+					page_search.max_matches);
+			}
+		}
+		show_overview();
+	}
+	update_search_status();
+}
+
+// search_page highlights the matches of the search text in a web_view, and
+// counts them.
+void browser::search_page(webkit::web_view& wv) {
+	auto fc = wv.get_find_controller();
+	page_search.controller = fc;
+	fc->search(page_search.text, webkit::find_controller::default_find_options,
+		page_search.max_matches);
+	fc->count_matches(page_search.text.c_str(),
+		webkit::find_controller::default_find_options, page_search.max_matches);
+}
+
+void browser::on_find_counted_matches(webkit::find_controller& fc, unsigned int count) {
+	// A count may arrive after the search text has changed, and would be
+	// stored against the new text.
+	auto wv = fc.get_web_view();
+	if (!page_search.is_searching() || !find_tab(*wv) ||
+		g_strcmp0(fc.get_search_text(), page_search.text.c_str()) != 0) {
+
+		return;
+	}
+	page_search.counts[wv] = count;
+	update_search_status();
+	if (page_search.all_tabs && overview->is_shown()) {
+		update_overview();
+	}
+}
+
+// update_search_status shows the number of matches in the shown tab, or the
+// total across every tab counted so far.
+void browser::update_search_status() {
+	std::string status;
+	const auto max = page_search.max_matches;
+	if (!page_search.is_searching()) {
+		// Nothing is searched for.
+	} else if (!page_search.all_tabs) {
+		auto it = page_search.counts.find(visable_tab.web_view);
+		if (it != page_search.counts.end()) {
+			status = match_count_text(it->second, max) + " matches";
+		}
+	} else {
+		unsigned int total = 0;
+		size_t tabs_matched = 0;
+		auto more = false;
+		for (auto& c : page_search.counts) {
+			if (c.second > max) {
+				more = true;
+				total += max;
+			} else {
+				total += c.second;
+			}
+			tabs_matched += c.second != 0;
+		}
+		status = (more ? "more than " : "") + std::to_string(total) +
+			" matches in " + std::to_string(tabs_matched) + " of " +
+			std::to_string(page_search.counts.size()) + " tabs";
+	}
+	page_search.matches->set_text(status);
 }
 
 int browser::open_new_tab(const char *uri) {
-	tabs.emplace_back(uri);
-	auto& tab = tabs.back();
-	auto& wv = *tab.wv;
+	open_tab(uri, 0);
+	return nb->get_n_pages() - 1;
+}
+
+// open_tab opens a tab as open_new_tab does.  A non-zero session_id is the
+// journal id of a restored tab; otherwise, the tab is newly recorded in the
+// session journal.  The tab's page is appended to the notebook, and the
+// handle of the tab is returned.
+slot_handle browser::open_tab(const char *uri, uint32_t session_id) {
+	const auto handle = tabs.emplace(uri);
+	auto& tab = *tabs.get(handle);
 
 	auto tab_content = gtk::box::create();
 	tab_content->set_can_focus(false);
 	tab_content->add(*tab.tab_title);
 	tab_content->add(*tab.tab_close);
 
-	wv.show_all();
+	// Only the (empty) page container is added to the notebook.  The
+	// web_view is not created until the tab is first shown.
+	tab.page->show();
 	tab_content->show_all();
-	const auto n = nb->append_page(wv, *tab_content);
-	nb->set_tab_reorderable(wv, true);
+	const auto n = nb->append_page(*tab.page, *tab_content);
+	nb->set_tab_reorderable(*tab.page, true);
 
 	tab.tab_close->connect_clicked(*this, on_tab_close_clicked);
+	tab_by_page[GTK_WIDGET(tab.page->ptr())] = handle;
+	tab_by_close[tab.tab_close.get()] = handle;
+
+	if (journal && !session_id) {
+		session_id = journal->tab_opened(n, uri);
+	}
+	tab.session_id = session_id;
+
+	return handle;
+}
+
+webkit::web_view& browser::materialize_tab(slot_handle handle) {
+	auto& tab = *tabs.get(handle);
+	if (tab.is_materialized()) {
+		return *tab.wv;
+	}
+
+	// A discarded session can only be restored to a web_view which has
+	// not loaded anything, so the spare, which may have run scripts, is
+	// not used for it.
+	auto view = tab.state ?
+		create_web_view() :
+		take_web_view();
+	apply_settings(tab, *view, tab.uri.c_str());
+	auto& wv = tab.materialize(std::move(view));
+	tab_by_view[&wv] = handle;
+
+	// The web_view's signals stay connected for its lifetime.  Slots
+	// which only concern the shown tab check for it themselves, rather
+	// than being reconnected whenever another tab is shown.
 	wv.connect_notify_title(*this, on_web_view_notify_title);
+	wv.connect_notify_uri(*this, on_web_view_notify_uri);
+	wv.connect_load_changed(*this, on_web_view_load_changed);
+	wv.connect_decide_policy(*this, on_web_view_decide_policy);
+	wv.connect_resource_load_started(*this, on_web_view_resource_load_started);
+	wv.connect_back_forward_list_changed(*this, on_back_forward_list_changed);
+	wv.get_find_controller()->connect_counted_matches(*this, on_find_counted_matches);
+	return wv;
+}
 
-	return n;
+// find_tab returns the tab of a materialized web_view, or null if the
+// web_view belongs to no tab.
+browser_tab *browser::find_tab(const webkit::web_view& wv) {
+	auto it = tab_by_view.find(&wv);
+	return it != tab_by_view.end() ? tabs.get(it->second) : nullptr;
+}
+
+// forget_web_view stops monitoring and throttling the web process of a
+// web_view about to be destroyed, thawing the process if it was frozen, and
+// forgets its count of page search matches.
+void browser::forget_web_view(webkit::web_view& wv) {
+	page_search.counts.erase(&wv);
+	if (auto usage = procs.usage(wv)) {
+		throttle->forget(usage->pid);
+	}
+	procs.view_destroyed(wv);
+}
+
+// throttle_tab lowers the CPU share of a hidden tab's web process, or freezes
+// it once idle, and restores the process of the shown tab.
+void browser::throttle_tab(browser_tab& tab, gint64 now) {
+	// A process which may have been matched to the wrong web_view might
+	// be that of the shown tab, or one playing audio, so it is left
+	// alone.
+	auto usage = tab.wv ? procs.usage(*tab.wv) : nullptr;
+	if (!usage || !usage->unambiguous) {
+		return;
+	}
+	auto state = process_throttler::state::background;
+	if (tab.wv.get() == visable_tab.web_view || tab.wv->is_playing_audio()) {
+		state = process_throttler::state::normal;
+	} else if (discard.freeze_timeout &&
+		now - tab.last_shown >= gint64{discard.freeze_timeout} * G_USEC_PER_SEC) {
+
+		state = process_throttler::state::frozen;
+	}
+	throttle->set_state(usage->pid, state);
+}
+
+// apply_settings gives a web_view the settings shared by the tabs of the
+// same mode as tab, or those of the site of uri, which is about to be loaded.
+// Site settings do not apply to lightweight tabs.
+void browser::apply_settings(const browser_tab& tab, webkit::web_view& wv,
+	const char *uri) {
+
+	auto settings = tab.lightweight ? view_options.lightweight_settings :
+		view_options.settings;
+	if (!tab.lightweight && view_options.sites) {
+		if (auto site = view_options.sites->find(uri)) {
+			settings = site;
+		}
+	}
+	if (settings) {
+		wv.set_settings(*settings);
+	}
+}
+
+// toggle_lightweight switches the shown tab into or out of lightweight mode,
+// reloading its page with the settings of the new mode.  The titles of
+// lightweight tabs are dimmed.
+void browser::toggle_lightweight() {
+	auto tab = tabs.get(visable_tab.tab);
+	if (!tab || !tab->wv || !view_options.lightweight_settings) {
+		return;
+	}
+	tab->lightweight = !tab->lightweight;
+	apply_settings(*tab, *tab->wv, tab->wv->get_uri());
+	auto style = tab->tab_title->get_style_context();
+	if (tab->lightweight) {
+		style->add_class("dim-label");
+	} else {
+		style->remove_class("dim-label");
+	}
+	tab->wv->reload();
+}
+
+void browser::discard_tab(browser_tab& tab) {
+	if (tab.wv) {
+		forget_web_view(*tab.wv);
+		tab.tab_title->set_tooltip_text(nullptr);
+	}
+	tab_by_view.erase(tab.wv.get());
+	tab.discard();
+}
+
+gtk::unique_ptr<webkit::web_view> browser::create_web_view() {
+	auto wv = gtk::unique_ptr<webkit::web_view>{gtk::make_sunk<webkit::web_view>(
+		view_options.context, view_options.content_manager)};
+	procs.view_created(*wv);
+	return wv;
+}
+
+// take_web_view returns the spare web_view, or a new one if there is none,
+// and schedules the creation of the next spare.
+gtk::unique_ptr<webkit::web_view> browser::take_web_view() {
+	gtk::unique_ptr<webkit::web_view> wv;
+	if (spare_view) {
+		wv = std::move(spare_view);
+	} else {
+		wv = create_web_view();
+	}
+	if (!spare_source) {
+		spare_source = gtk::idle_add(G_PRIORITY_LOW, *this, on_spare_idle);
+	}
+	return wv;
+}
+
+bool browser::on_spare_idle() {
+	spare_source = 0;
+	if (!spare_view) {
+		spare_view = create_web_view();
+		// Running a script starts the spare's web process, in its
+		// initial empty document.  Loading a blank page instead would
+		// leave it as a back item in the history of the tab.
+		spare_view->run_javascript("void 0");
+	}
+	return G_SOURCE_REMOVE;
 }
 
 void browser::show_window() {
 	window->show();
 }
 
+void browser::present() {
+	window->present();
+	focus_queued = true;
+}
+
+void browser::set_history(history& h) {
+	hist = &h;
+}
+
+void browser::set_text_index(text_index& t) {
+	page_texts = &t;
+}
+
+void browser::set_cache_monitor(cache_monitor& c) {
+	cache = &c;
+}
+
+void browser::set_load_stats(load_stats& s) {
+	loads = &s;
+}
+
+void browser::set_snapshot_cache(snapshot_cache& c) {
+	snapshots = &c;
+	overview->set_snapshot_cache(c);
+	auto o = overview.get();
+	c.set_changed([o] { o->redraw(); });
+}
+
+// snapshot_key identifies the thumbnail of a tab.  Handles are never reused,
+// so a closed tab's thumbnail is never mistaken for another's.
+static uint64_t snapshot_key(slot_handle handle) {
+	return uint64_t{handle.index} << 32 | handle.generation;
+}
+
+// capture_snapshot replaces the thumbnail of a materialized tab with the
+// page it currently shows.
+void browser::capture_snapshot(slot_handle handle) {
+	auto tab = tabs.get(handle);
+	if (snapshots && tab && tab->wv) {
+		snapshots->capture(snapshot_key(handle), *tab->wv);
+	}
+}
+
+// show_overview replaces the notebook with a grid of every tab, in notebook
+// order, with the current tab selected.
+void browser::show_overview() {
+	capture_snapshot(visable_tab.tab);
+	update_overview();
+}
+
+// update_overview shows every tab in the tab overview, in notebook order.
+// While searching every tab, only the tabs with matches are shown instead,
+// those with the most matches first.
+void browser::update_overview() {
+	struct shown_tab {
+		slot_handle handle;
+		unsigned int matches;
+	};
+	std::vector<shown_tab> shown;
+	const auto ranked = page_search.all_tabs && page_search.is_searching();
+	const auto n_pages = nb->get_n_pages();
+	shown.reserve(n_pages);
+	for (int i = 0; i < n_pages; ++i) {
+		auto handle = tab_by_page.at(nb->get_nth_page(i)->ptr());
+		if (!ranked) {
+			shown.push_back({handle, 0});
+			continue;
+		}
+		auto& tab = *tabs.get(handle);
+		auto it = page_search.counts.find(tab.wv.get());
+		if (it != page_search.counts.end() && it->second) {
+			shown.push_back({handle, it->second});
+		}
+	}
+	size_t selected = nb->get_current_page();
+	if (ranked) {
+		std::stable_sort(shown.begin(), shown.end(),
+			[](const shown_tab& a, const shown_tab& b) {
+				return a.matches > b.matches;
+			});
+		selected = 0;
+	}
+
+	std::vector<tab_overview::item> items;
+	items.reserve(shown.size());
+	overview_tabs.clear();
+	for (auto& s : shown) {
+		auto& tab = *tabs.get(s.handle);
+		const char *title = tab.wv ? tab.wv->get_title() : nullptr;
+		if (!title || !*title) {
+			title = tab.tab_title->get_text();
+		}
+		auto label = std::string{title};
+		if (ranked) {
+			label = '(' + match_count_text(s.matches, page_search.max_matches) +
+				") " + label;
+		}
+		items.push_back({snapshot_key(s.handle), std::move(label)});
+		overview_tabs.push_back(s.handle);
+	}
+
+	nb->hide();
+	overview->show(std::move(items), selected);
+}
+
+void browser::hide_overview() {
+	overview->hide();
+	nb->show();
+	if (visable_tab.web_view) {
+		visable_tab.web_view->grab_focus();
+	}
+}
+
+bool browser::on_process_timeout() {
+	procs.sample();
+	update_process_tooltips();
+
+	// Processes are only throttled once matched to their web_view, and
+	// hidden tabs become frozen as they idle.
+	const auto now = g_get_monotonic_time();
+	for (auto& tab : tabs) {
+		throttle_tab(tab, now);
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+// update_process_tooltips shows the last sampled memory and CPU use of each
+// tab's web process in the tooltip of its title.
+void browser::update_process_tooltips() {
+	char text[128];
+	for (auto& tab : tabs) {
+		if (!tab.wv) {
+			continue;
+		}
+		auto usage = procs.usage(*tab.wv);
+		if (!usage) {
+			tab.tab_title->set_tooltip_text(nullptr);
+			continue;
+		}
+		snprintf(text, sizeof(text), "Web process %d\n"
+			"%.1f MB resident, %.1f MB proportional\n%.1f%% CPU",
+			static_cast<int>(usage->pid), usage->rss / 1048576.0,
+			usage->pss / 1048576.0, usage->cpu);
+		tab.tab_title->set_tooltip_text(text);
+	}
+}
+
+void browser::append_process_stats(std::string& out) const {
+	out += "# web process pid rss_kb pss_kb cpu_percent uri\n";
+	char line[64];
+	for (auto& tab : tabs) {
+		const process_usage *usage;
+		if (!tab.wv || !(usage = procs.usage(*tab.wv))) {
+			continue;
+		}
+		snprintf(line, sizeof(line), "%d %llu %llu %.1f ", static_cast<int>(usage->pid),
+			static_cast<unsigned long long>(usage->rss >> 10),
+			static_cast<unsigned long long>(usage->pss >> 10), usage->cpu);
+		out += line;
+		out += tab.wv->get_uri();
+		out += '\n';
+	}
+}
+
+void browser::append_speculation_stats(std::string& out) const {
+	spec.append_stats(out);
+}
+
+void browser::set_discard_policy(const discard_policy& policy) {
+	discard = policy;
+	discard_tabs();
+}
+
+void browser::discard_tabs() {
+	const auto now = g_get_monotonic_time();
+	const auto idle_timeout = gint64{discard.idle_timeout} * G_USEC_PER_SEC;
+
+	// Discard all idle tabs, collecting the remaining hidden tabs which
+	// may be discarded to meet the live view limit.
+	std::vector<browser_tab *> candidates;
+	unsigned int live = 0;
+	for (auto& tab : tabs) {
+		if (!tab.is_materialized()) {
+			continue;
+		}
+		if (tab.wv.get() == visable_tab.web_view || tab.wv->is_playing_audio()) {
+			++live;
+			continue;
+		}
+		if (idle_timeout && now - tab.last_shown >= idle_timeout) {
+			discard_tab(tab);
+			continue;
+		}
+		++live;
+		candidates.push_back(&tab);
+	}
+
+	if (!discard.max_live_views || live <= discard.max_live_views) {
+		return;
+	}
+	auto excess = std::min<size_t>(live - discard.max_live_views, candidates.size());
+	std::partial_sort(candidates.begin(), candidates.begin() + excess, candidates.end(),
+		[](auto a, auto b) { return a->last_shown < b->last_shown; });
+	for (size_t i = 0; i < excess; ++i) {
+		discard_tab(*candidates[i]);
+	}
+}
+
+bool browser::on_discard_timeout() {
+	discard_tabs();
+	return G_SOURCE_CONTINUE;
+}
+
+void browser::queue_uri(std::string uri) {
+	guess_scheme(uri);
+	queue_tab(std::move(uri), 0);
+}
+
+void browser::queue_tab(std::string uri, uint32_t session_id) {
+	uri_queue.push_back(queued_tab{std::move(uri), session_id});
+
+	if (!uri_queue_source) {
+		uri_queue_source = gtk::idle_add(G_PRIORITY_DEFAULT_IDLE, *this,
+			on_uri_queue_idle);
+	}
+}
+
+bool browser::on_uri_queue_idle() {
+	const auto deadline = g_get_monotonic_time() + uri_queue_budget;
+	do {
+		const auto& queued = uri_queue.front();
+		auto only_tab = tabs.size() == 1 ? &*tabs.begin() : nullptr;
+		if (!queued.session_id && only_tab && only_tab->is_materialized() &&
+			is_blank(only_tab->wv->get_uri())) {
+
+			only_tab->wv->load_uri(queued.uri);
+			focus_queued = false;
+		} else {
+			open_tab(queued.uri.c_str(), queued.session_id);
+			if (focus_queued) {
+				nb->set_current_page(nb->get_n_pages() - 1);
+				focus_queued = false;
+			}
+		}
+		uri_queue.pop_front();
+	} while (!uri_queue.empty() && g_get_monotonic_time() < deadline);
+
+	if (uri_queue.empty()) {
+		uri_queue_source = 0;
+		return G_SOURCE_REMOVE;
+	}
+	return G_SOURCE_CONTINUE;
+}
+
 void browser::on_tab_close_clicked(gtk::button& tab_close) {
-	auto removed_tab = std::find_if(std::cbegin(tabs), std::cend(tabs),
-		[&tab_close](auto& t) { return t.tab_close.get() == &tab_close; });
-	auto removed_index = std::distance(std::cbegin(tabs), removed_tab);
-	tabs.erase(removed_tab);
+	auto it = tab_by_close.find(&tab_close);
+	if (it != tab_by_close.end()) {
+		close_tab(it->second);
+	}
+}
 
-	if (tabs.size() == 0) {
-		window->destroy();
+// close_tab removes a tab from the browser, destroying the browser window
+// when no tabs remain.
+void browser::close_tab(slot_handle handle) {
+	if (!tabs.contains(handle)) {
 		return;
 	}
+	{
+		// The tab is taken out of the slot map before its page is
+		// destroyed, so the tabs are consistent by the time the
+		// notebook switches away from a removed page.
+		auto removed = tabs.take(handle);
+		if (journal) {
+			journal->tab_closed(removed.session_id);
+		}
+		if (removed.wv) {
+			forget_web_view(*removed.wv);
+		}
+		tab_by_page.erase(GTK_WIDGET(removed.page->ptr()));
+		tab_by_view.erase(removed.wv.get());
+		tab_by_close.erase(removed.tab_close.get());
+	}
 
-	// If the removed tab had an index smaller than the visable tab, the
-	// visable tab index must be decremented.
-	auto prev_index = visable_tab.tab_index;
-	if (removed_index < prev_index) {
-		visable_tab.tab_index = prev_index - 1;
+	if (snapshots) {
+		snapshots->erase(snapshot_key(handle));
+	}
+	if (tabs.empty()) {
+		window->destroy();
+	} else if (overview->is_shown()) {
+		update_overview();
 	}
 }
 
@@ -339,39 +1234,36 @@ void browser::on_back_forward_list_changed(WebKitBackForwardList& bfl,
 }
 
 void browser::on_web_view_notify_uri(webkit::web_view& web_view, GParamSpec& param_spec) {
-	nav_entry->set_uri(web_view.get_uri());
+	auto uri = web_view.get_uri();
+	if (visable_tab.web_view == &web_view) {
+		nav_entry->set_uri(is_blank(uri) ? "" : uri);
+	}
+
+	if (journal) {
+		if (auto tab = find_tab(web_view)) {
+			journal->uri_changed(tab->session_id, uri);
+		}
+	}
 }
 
-static void on_nav_entry_refresh_clicked(uri_entry *entry, webkit::web_view *web_view) {
-	web_view->reload();
-	web_view->grab_focus();
+void browser::on_nav_entry_refresh_clicked(uri_entry& entry) {
+	visable_tab.web_view->reload();
+	visable_tab.web_view->grab_focus();
 }
 
 void browser::on_notebook_page_reordered(gtk::notebook& notebook, gtk::widget& child,
 	unsigned int new_idx) {
 
-	// NOTE: This only works when reordering the current visable tab.
-	// However, this appears to be a safe assumption since, at least
-	// when using the mouse to drag and drop tabs (which is the only
-	// method we have of reordering them), the tab being reordered
-	// is always focused first.
-	auto old_idx = visable_tab.tab_index;
-	auto tmp = std::move(tabs[old_idx]);
-	if (old_idx < new_idx) {
-		// Moving the range [old_idx+1, new_idx+1) to [old_idx, new_idx).
-		std::move(tabs.begin()+old_idx+1, tabs.begin()+new_idx+1,
-			tabs.begin()+old_idx);
-	} else {
-		// Moving the range [new_idx, old_idx) to [new_idx+1, old_idx+1).
-		std::move_backward(tabs.begin()+new_idx, tabs.begin()+old_idx,
-			tabs.begin()+old_idx+1);
+	// The notebook alone orders the tabs, so nothing but the journal
+	// needs to know of the move, whichever tab was moved.
+	auto it = tab_by_page.find(child.ptr());
+	if (journal && it != tab_by_page.end()) {
+		journal->tab_moved(tabs.get(it->second)->session_id, new_idx);
 	}
-	tabs[new_idx] = std::move(tmp);
-	visable_tab.tab_index = new_idx;
 }
 
-void browser::show_webview(unsigned int page_num, webkit::web_view& wv) {
-	visable_tab = {page_num, wv};
+void browser::show_webview(slot_handle tab, webkit::web_view& wv) {
+	visable_tab = {tab, wv};
 
 	// Update navbar/titlebar with the current state of the webview being
 	// shown.
@@ -382,24 +1274,13 @@ void browser::show_webview(unsigned int page_num, webkit::web_view& wv) {
 	window->set_title(title);
 	update_histnav(wv);
 	auto uri = wv.get_uri();
-	nav_entry->set_uri(uri);
-
-	page_signals = { {
-		back->connect_clicked(*this, on_back_button_clicked),
-		fwd->connect_clicked(*this, on_fwd_button_clicked),
-		wv.connect_back_forward_list_changed(*this, on_back_forward_list_changed),
-		wv.connect_notify_uri(*this, on_web_view_notify_uri),
-		wv.connect_load_changed(*this, on_web_view_load_changed),
-		nav_entry->connect_refresh_clicked(wv, ::on_nav_entry_refresh_clicked),
-		nb->connect_page_reordered(*this, on_notebook_page_reordered),
-		page_search.entry->connect_search_changed(*this, on_page_search_changed),
-	} };
+	nav_entry->set_uri(is_blank(uri) ? "" : uri);
 
 	// Grab URI entry focus if the shown tab is blank.
 	//
 	// TODO: If this webview is being shown by clicking another notebook
 	// tab, grabbing the entry focus has no effect.
-	if (!strcmp(uri, "")) {
+	if (is_blank(uri)) {
 		nav_entry->grab_focus();
 	} else {
 		wv.grab_focus();
@@ -411,25 +1292,440 @@ void browser::update_histnav(webkit::web_view& wv) {
 	fwd->set_sensitive(wv.can_go_forward());
 }
 
-void browser::switch_page(unsigned int page_num) {
-	// Disconnect previous web_view's signals before showing and connecting
-	// the new web_view.
-	for (auto& sig : page_signals) {
-		sig.disconnect();
+void browser::switch_page(slot_handle handle) {
+	// Record when the previously shown tab was hidden, so that it may
+	// later be discarded once idle.  It may already have been closed.
+	const auto now = g_get_monotonic_time();
+	auto prev = tabs.get(visable_tab.tab);
+	if (prev) {
+		prev->last_shown = now;
+	}
+
+	// The hidden tab's page is captured for the tab overview.
+	if (prev) {
+		capture_snapshot(visable_tab.tab);
+	}
+	if (overview->is_shown()) {
+		hide_overview();
+	}
+
+	auto& tab = *tabs.get(handle);
+	tab.last_shown = now;
+	auto& wv = materialize_tab(handle);
+	show_webview(handle, wv);
+
+	// An open search continues in the shown tab.
+	if (page_search.is_searching()) {
+		search_page(wv);
+	}
+
+	// Throttle the hidden tab's web process, and restore the shown one.
+	if (prev) {
+		throttle_tab(*prev, now);
+	}
+	throttle_tab(tab, now);
+
+	// Materializing the tab may have exceeded the live view limit.
+	discard_tabs();
+}
+
+// drain_events processes every pending event without blocking.
+static void drain_events() {
+	while (gtk_events_pending()) {
+		gtk_main_iteration_do(false);
+	}
+}
+
+std::string browser::benchmark(const std::vector<unsigned int>& counts, const char *uri) {
+	std::vector<tab_benchmark_run> runs;
+	for (auto count : counts) {
+		runs.emplace_back();
+		auto& run = runs.back();
+		run.tabs = count;
+
+		std::vector<slot_handle> opened;
+		opened.reserve(count);
+		const auto first_page = nb->get_n_pages();
+		for (unsigned int i = 0; i < count; ++i) {
+			const auto start = g_get_monotonic_time();
+			opened.push_back(open_tab(uri, 0));
+			run.open.add(g_get_monotonic_time() - start);
+			drain_events();
+		}
+
+		// Switching pages shows (and so materializes) each tab, as
+		// the notebook would when the user switches to it.
+		for (unsigned int i = 0; i < count; ++i) {
+			const auto start = g_get_monotonic_time();
+			nb->set_current_page(first_page + i);
+			run.show.add(g_get_monotonic_time() - start);
+			drain_events();
+		}
+		run.rss_open = resident_size();
+
+		for (auto handle : opened) {
+			const auto start = g_get_monotonic_time();
+			close_tab(handle);
+			run.close.add(g_get_monotonic_time() - start);
+			drain_events();
+		}
+		run.rss_closed = resident_size();
+	}
+
+	std::string out;
+	append_benchmark_json(out, uri, discard.max_live_views, runs);
+	return out;
+}
+
+
+static void usage() {
+	fprintf(stderr, "usage: volo [-Bn] [-c cache-dir] [-C cache-megabytes] [-i idle-seconds]\n"
+		"            [-m max-live-views] [-f file] [-F find-max-matches]\n"
+		"            [-s stats-file] [-t stall-ms] [-M snapshot-megabytes]\n"
+		"            [-S snapshot-dir] [-z freeze-seconds] [uri ...]\n"
+		"       volo -b tab-counts [-B] [-m max-live-views] [uri]\n"
+		"       volo -P load-count [-R archive-dir] [uri]\n"
+		"       volo -r archive-dir | -R archive-dir [-L latency-ms] [-W kbytes-per-sec]\n"
+		"            [-b tab-counts] [other options] [uri ...]\n");
+	exit(2);
+}
+
+// Page loaded by every tab of a benchmark when no URI is given.  The bench
+// target loads fixtures/tab.html instead.
+static const char benchmark_page[] =
+	"data:text/html,<!DOCTYPE html><title>volo benchmark</title><p>volo benchmark</p>";
+
+// benchmark_target returns the URI of a benchmark's page, which may be given
+// as the path of a local file, such as a fixture.
+static std::string benchmark_target(const char *arg) {
+	if (!g_file_test(arg, G_FILE_TEST_IS_REGULAR)) {
+		return arg;
+	}
+	auto path = realpath(arg, nullptr);
+	auto uri = path ? g_filename_to_uri(path, nullptr, nullptr) : nullptr;
+	free(path);
+	if (!uri) {
+		return arg;
 	}
+	std::string s{uri};
+	g_free(uri);
+	return s;
+}
 
-	show_webview(page_num, *tabs[page_num].wv);
+struct benchmark_args {
+	browser *b;
+	std::vector<unsigned int> counts;
+	const char *uri;
+};
+
+// on_benchmark_idle runs a benchmark once the browser window is shown,
+// writing its results to stdout, and quits.
+static gboolean on_benchmark_idle(gpointer data) {
+	auto args = static_cast<benchmark_args *>(data);
+	auto json = args->b->benchmark(args->counts, args->uri);
+	fputs(json.c_str(), stdout);
+	gtk_main_quit();
+	return G_SOURCE_REMOVE;
 }
 
+// parse_counts parses a comma separated list of tab counts.
+static std::vector<unsigned int> parse_counts(const char *s) {
+	std::vector<unsigned int> counts;
+	while (*s) {
+		char *end;
+		auto n = strtoul(s, &end, 10);
+		if (end == s || (*end && *end != ',') || !n) {
+			usage();
+		}
+		counts.push_back(n);
+		s = *end ? end + 1 : end;
+	}
+	return counts;
+}
+
+// on_dump_signal writes the page load stats when SIGUSR1 is received.
+static gboolean on_dump_signal(gpointer stats) {
+	static_cast<load_stats *>(stats)->dump();
+	return G_SOURCE_CONTINUE;
+}
 
 int main(int argc, char **argv) {
+	// Only GTK's options are parsed before checking for a running
+	// instance.  The display is not opened until it is known that this
+	// process will run the browser.
+	gtk_parse_args(&argc, &argv);
+
+	auto policy = discard_policy{};
+	auto caching = cache_policy{};
+	const char *uri_file = nullptr;
+	const char *stats_file = nullptr;
+	auto new_instance = false;
+	auto block_content = true;
+	std::vector<unsigned int> benchmark_counts;
+	unsigned int benchmark_loads = 0;
+	const char *archive_dir = nullptr;
+	auto archive_mode = replay_proxy::mode::replay;
+	auto shaping = replay_shaping{};
+	auto snapshot_opts = snapshot_policy{};
+	unsigned int max_find_matches = webkit::find_controller::default_max_matches;
+	int ch;
+	while ((ch = getopt(argc, argv, "BC:c:b:F:f:i:L:M:m:nP:R:r:S:s:t:W:z:")) != -1) {
+		switch (ch) {
+		case 'B':
+			block_content = false;
+			break;
+		case 'b':
+			benchmark_counts = parse_counts(optarg);
+			break;
+		case 'C':
+			// A zero limit disables caching.
+			caching.max_disk_size = strtoull(optarg, nullptr, 10) << 20;
+			if (!caching.max_disk_size) {
+				caching.model = WEBKIT_CACHE_MODEL_DOCUMENT_VIEWER;
+			}
+			break;
+		case 'c':
+			caching.directory = optarg;
+			break;
+		case 'F':
+			max_find_matches = strtoul(optarg, nullptr, 10);
+			break;
+		case 'f':
+			uri_file = optarg;
+			break;
+		case 'n':
+			new_instance = true;
+			break;
+		case 'i':
+			policy.idle_timeout = strtoul(optarg, nullptr, 10);
+			break;
+		case 'L':
+			shaping.latency = strtoul(optarg, nullptr, 10);
+			break;
+		case 'M':
+			snapshot_opts.memory_budget = strtoull(optarg, nullptr, 10) << 20;
+			break;
+		case 'm':
+			policy.max_live_views = strtoul(optarg, nullptr, 10);
+			break;
+		case 'P':
+			benchmark_loads = strtoul(optarg, nullptr, 10);
+			if (!benchmark_loads) {
+				usage();
+			}
+			break;
+		case 'R':
+			archive_dir = optarg;
+			archive_mode = replay_proxy::mode::replay;
+			break;
+		case 'r':
+			archive_dir = optarg;
+			archive_mode = replay_proxy::mode::record;
+			break;
+		case 'S':
+			snapshot_opts.spill_directory = optarg;
+			break;
+		case 's':
+			stats_file = optarg;
+			break;
+		case 't':
+			stall_monitor::enable(strtoul(optarg, nullptr, 10));
+			break;
+		case 'W':
+			shaping.bytes_per_sec = strtoul(optarg, nullptr, 10) << 10;
+			break;
+		case 'z':
+			policy.freeze_timeout = strtoul(optarg, nullptr, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	// URIs may be listed on the command line, and read (one per line)
+	// from a file, or from stdin when the file is "-".
+	auto uris = std::vector<const char *>{argv + optind, argv + argc};
+	if (uris.empty()) {
+		uris.push_back("");
+	}
+
+	// A benchmark runs in a new instance with a single blank tab, and
+	// leaves the session, history and stats of other instances alone.
+	// It may be run headless under Xvfb, or with GDK_BACKEND=broadway.
+	const auto benchmarking = !benchmark_counts.empty() || benchmark_loads;
+	std::string benchmark_uri = benchmark_page;
+	if (benchmarking) {
+		if (uris.size() > 1 || uri_file || (!benchmark_counts.empty() && benchmark_loads)) {
+			usage();
+		}
+		if (*uris.front()) {
+			benchmark_uri = benchmark_target(uris.front());
+		}
+		uris.front() = "";
+		new_instance = true;
+	}
+
+	// Loads through a record or replay proxy are only made by a new
+	// instance, as a running browser's web context does not use it.
+	if (archive_dir) {
+		new_instance = true;
+	}
+	auto uri_fd = -1;
+	if (uri_file && !strcmp(uri_file, "-")) {
+		uri_fd = STDIN_FILENO;
+	} else if (uri_file) {
+		uri_fd = open(uri_file, O_RDONLY | O_CLOEXEC);
+		if (uri_fd == -1) {
+			err(1, "%s", uri_file);
+		}
+	}
+
+	// Unless a new instance was requested, hand the URIs to an already
+	// running browser and exit.  If they cannot be handed over, this
+	// process becomes the browser, and opens them (and the rest of the
+	// URI file) itself.
+	instance inst;
+	if (!new_instance && inst.forward(uris, uri_fd)) {
+		if (uri_fd != -1) {
+			close(uri_fd);
+		}
+		return 0;
+	}
+
 	gtk_init(&argc, &argv);
 
-	auto web_cxt = webkit::web_context::get_default();
+	// The default web context's disk cache location cannot be changed,
+	// so all web_views are created in a context of our own.
+	auto data_manager = gtk::unique_ptr<webkit::website_data_manager,
+		gtk::unref_delete<webkit::website_data_manager>>{
+		webkit::website_data_manager::create(
+			caching.directory.empty() ? nullptr : caching.directory.c_str())};
+	auto web_cxt = gtk::unique_ptr<webkit::web_context,
+		gtk::unref_delete<webkit::web_context>>{
+		webkit::web_context::create(*data_manager)};
 	web_cxt->set_process_model(WEBKIT_PROCESS_MODEL_MULTIPLE_SECONDARY_PROCESSES);
 	web_cxt->set_tls_errors_policy(WEBKIT_TLS_ERRORS_POLICY_FAIL);
+	web_cxt->set_cache_model(caching.model);
+
+	// Every load may be recorded to, or replayed from, an archive
+	// through a proxy of our own.
+	std::unique_ptr<replay_proxy> proxy;
+	if (archive_dir) {
+		proxy = std::make_unique<replay_proxy>(archive_mode, archive_dir, shaping);
+		if (!proxy->start()) {
+			errx(1, "unable to start the replay proxy");
+		}
+		auto settings = webkit_network_proxy_settings_new(proxy->proxy_uri().c_str(),
+			nullptr);
+		web_cxt->set_network_proxy_settings(WEBKIT_NETWORK_PROXY_MODE_CUSTOM, settings);
+		webkit_network_proxy_settings_free(settings);
+	}
 
-	auto b = browser{};
+	cache_monitor cache{*data_manager, caching};
+	cache.measure();
+
+	// The primary instance saves its tabs to the session journal and
+	// restores the tabs of its previous session.
+	session_journal journal;
+	auto journaled = !new_instance && journal.open();
+
+	history hist;
+	text_index page_texts;
+	load_stats loads;
+	if (!benchmarking) {
+		hist.open();
+		// Only the first instance indexes pages, as it holds the
+		// index's lock until it exits.
+		page_texts.open();
+
+		// Page load times are written to the stats file on SIGUSR1
+		// and at exit.
+		loads.open(stats_file);
+		g_unix_signal_add(SIGUSR1, on_dump_signal, &loads);
+	}
+
+	// All web_views share one user content manager, whose content
+	// filters are added once they have been loaded or compiled.
+	content_blocker blocker;
+	if (block_content || benchmark_loads) {
+		blocker.load();
+	}
+
+	// The page load benchmark compares loads with and without the
+	// content filters, so it waits until they are ready, and needs no
+	// browser.  Pages recorded with -r make repeatable fixtures when
+	// replayed with -R.
+	if (benchmark_loads) {
+		load_benchmark bench{*web_cxt, blocker.content_manager(), benchmark_uri.c_str(),
+			benchmark_loads};
+		blocker.set_ready([&bench] {
+			bench.run([](const std::string& json) {
+				fputs(json.c_str(), stdout);
+				gtk_main_quit();
+			});
+		});
+		gtk_main();
+		return 0;
+	}
+
+	// Lightweight tabs load pages without scripts, images, WebGL or
+	// media, which is enough for many documents and dashboards at a
+	// fraction of the CPU and memory.  Only the pages' own scripts are
+	// disabled: the scripts volo runs to index text, account for the
+	// cache and preconnect still run.
+	using settings_ptr = gtk::unique_ptr<webkit::settings,
+		gtk::unref_delete<webkit::settings>>;
+	auto settings = settings_ptr{webkit::settings::create()};
+	auto lightweight_settings = settings_ptr{webkit::settings::create()};
+	lightweight_settings->set_enable_javascript_markup(false);
+	lightweight_settings->set_auto_load_images(false);
+	lightweight_settings->set_enable_webgl(false);
+	lightweight_settings->set_enable_media(false);
+	lightweight_settings->set_enable_mediasource(false);
+	lightweight_settings->set_enable_webaudio(false);
+
+	// Sites may override the settings of other tabs.
+	site_settings sites;
+	sites.load();
+
+	auto view_options = web_view_options{};
+	view_options.context = web_cxt.get();
+	view_options.content_manager = &blocker.content_manager();
+	view_options.settings = settings.get();
+	view_options.lightweight_settings = lightweight_settings.get();
+	view_options.sites = &sites;
+
+	// Thumbnails of hidden tabs for the tab overview are kept within a
+	// memory budget, and spilled to disk beyond it if a directory is set.
+	snapshot_cache snapshots{snapshot_opts};
+
+	auto b = browser{uris, journaled ? &journal : nullptr, view_options};
+	b.set_discard_policy(policy);
+	b.set_cache_monitor(cache);
+	b.set_max_find_matches(max_find_matches);
+	if (benchmarking) {
+		auto args = benchmark_args{&b, benchmark_counts, benchmark_uri.c_str()};
+		b.show_window();
+		g_idle_add(on_benchmark_idle, &args);
+		gtk_main();
+		return 0;
+	}
+	b.set_load_stats(loads);
+	loads.add_section([&b](std::string& out) { b.append_process_stats(out); });
+	loads.add_section([&b](std::string& out) { b.append_speculation_stats(out); });
+	loads.add_section(stall_monitor::append_stats);
+	loads.add_section([&cache](std::string& out) { cache.append_stats(out); });
+	b.set_history(hist);
+	b.set_text_index(page_texts);
+	b.set_snapshot_cache(snapshots);
+	if (uri_fd != -1) {
+		uri_reader::watch(uri_fd, b);
+	}
+	if (!new_instance && !inst.listen(b)) {
+		g_warning("volo: unable to listen for other instances");
+	}
 	b.show_window();
 	gtk_main();
+
+	loads.dump();
 }
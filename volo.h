@@ -6,10 +6,30 @@
 #define _VOLO_H
 
 #include <array>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <gtk.h>
 #include <webkit.h>
+#include <benchmark.h>
+#include <cache.h>
+#include <history.h>
+#include <load_stats.h>
+#include <process_monitor.h>
+#include <replay_proxy.h>
+#include <resource_log.h>
+#include <session.h>
+#include <site_settings.h>
+#include <slot_map.h>
+#include <snapshot_cache.h>
+#include <speculator.h>
+#include <stall_monitor.h>
+#include <tab_overview.h>
+#include <text_index.h>
+#include <throttler.h>
 #include <uri_entry.h>
 
 namespace volo {
@@ -17,22 +37,108 @@ namespace volo {
 // browser_tab represents the widgets added to the browser's notebook.  Note
 // that there is an additional box which holds the tab's title and close button
 // that is not owned by this struct.
+//
+// Tabs are materialized lazily.  Until a tab is first shown, only the page
+// container and tab label are created and the URI to load is saved, so no
+// web_view (or web process) exists for it.  The web_view is created and
+// added to the page by materialize.  A materialized tab may later be
+// discarded, returning it to this state while remembering its session.
 struct browser_tab {
+	gtk::unique_ptr<gtk::box> page;
 	gtk::unique_ptr<webkit::web_view> wv;
 	gtk::unique_ptr<gtk::label> tab_title;
 	gtk::unique_ptr<gtk::button> tab_close;
+	// URI to load when the tab is materialized.  Cleared afterwards,
+	// as the web_view then tracks the current URI.
+	std::string uri;
+	// Session state saved when the tab was discarded, if any.
+	webkit::session_state state;
+	// Monotonic time (in microseconds) the tab was last shown or hidden.
+	gint64 last_shown{0};
+	// Id of the tab in the session journal, or zero when not journaled.
+	uint32_t session_id{0};
+	// Timing of the current, or last, page load of the web_view, and of
+	// each of its resources.  The resource log exists only while the tab
+	// is materialized.
+	load_timing load;
+	std::unique_ptr<resource_log> resources;
+	// Whether the tab's pages are loaded without scripts, images, WebGL
+	// or media.  Kept while the tab is discarded.
+	bool lightweight{false};
+	// Whether the first page of a web_view which had no session restored
+	// has yet to commit.  The page should have no previous history item.
+	bool first_commit{false};
 
 	browser_tab(const char *);
+
+	bool is_materialized() const { return wv != nullptr; }
+
+	// materialize creates the tab's web_view, if it does not already
+	// exist, from a new or spare web_view.  The saved URI begins
+	// loading, or the session saved by discard is restored (which
+	// requires a web_view that has loaded nothing).  The web_view is
+	// left as is for a blank tab.
+	webkit::web_view& materialize(gtk::unique_ptr<webkit::web_view>);
+
+	// discard saves the session state, URI and title of the tab and
+	// destroys its web_view.
+	void discard();
+};
+
+// discard_policy describes when hidden tabs are discarded.  Tabs hidden for
+// at least idle_timeout seconds are discarded, and whenever more than
+// max_live_views tabs are materialized, the least recently shown hidden
+// tabs are discarded until the limit is met.  A zero value disables the
+// respective limit.  Tabs playing audio are never discarded.
+//
+// The web processes of hidden tabs run at a lower CPU share, and when
+// freeze_timeout is nonzero, are frozen once hidden for that many seconds,
+// until the tab is shown again.  Tabs playing audio are never throttled.
+struct discard_policy {
+	unsigned int idle_timeout{30 * 60};
+	unsigned int max_live_views{16};
+	unsigned int freeze_timeout{0};
+};
+
+// web_view_options describes how the browser creates web_views.  Members
+// which are null use WebKit's defaults.
+struct web_view_options {
+	webkit::web_context *context{nullptr};
+	webkit::user_content_manager *content_manager{nullptr};
+	// Settings shared by the web_views of lightweight tabs, and by those
+	// of all other tabs.  Tabs cannot be made lightweight without them.
+	webkit::settings *lightweight_settings{nullptr};
+	webkit::settings *settings{nullptr};
+	// Settings overridden for particular sites, in tabs which are not
+	// lightweight.
+	const site_settings *sites{nullptr};
 };
 
+// search_bar finds text in the shown tab, or also counts its matches in every
+// materialized tab, showing the number of matches beside the entry.
 struct search_bar {
 	gtk::unique_ptr<gtk::search_bar> bar;
+	gtk::unique_ptr<gtk::box> box;
 	gtk::unique_ptr<gtk::search_entry> entry;
-	webkit::find_controller *controller;
+	gtk::unique_ptr<gtk::label> matches;
+	webkit::find_controller *controller{nullptr};
+	// Whether every tab is searched, ranking the tabs with matches in
+	// the tab overview.
+	bool all_tabs{false};
+	// Matches are counted, and highlighted, up to this many per tab.
+	unsigned int max_matches{webkit::find_controller::default_max_matches};
+	// The text being searched for, and the number of its matches in each
+	// web_view which has been counted.
+	std::string text;
+	std::unordered_map<const webkit::web_view *, unsigned int> counts;
+	unsigned int delay_source{0};
 
 	search_bar();
 
-	void begin_searching(webkit::web_view&);
+	void begin_searching(webkit::web_view&, bool all_tabs);
+
+	// is_searching returns whether the bar is shown with text to find.
+	bool is_searching() const;
 };
 
 // browser represents the top level widget which creates the browser.  It
@@ -43,9 +149,13 @@ struct search_bar {
 //
 // A browser will show no less than one tab at all times.  Removing the last
 // tab will close the browser.
+//
+// Tabs are referred to by stable handles into a slot map, so opening, closing
+// and moving a tab never invalidates the others.  The order of the tabs is
+// kept only by the notebook; each notebook page maps back to its tab.
 class browser {
 private:
-	std::vector<browser_tab> tabs;
+	slot_map<browser_tab> tabs;
 	gtk::unique_ptr<gtk::window> window;
 	gtk::unique_ptr<gtk::header_bar> navbar;
 	gtk::unique_ptr<gtk::box> histnav;
@@ -55,23 +165,78 @@ private:
 	gtk::unique_ptr<uri_entry> nav_entry;
 	gtk::unique_ptr<gtk::notebook> nb;
 	search_bar page_search{};
+	discard_policy discard{};
+	session_journal *journal{nullptr};
+	history *hist{nullptr};
+	text_index *page_texts{nullptr};
+	web_view_options view_options;
+	cache_monitor *cache{nullptr};
+	load_stats *loads{nullptr};
+	// Thumbnails of the tabs, taken as each tab is hidden, and the grid
+	// which shows them in place of the notebook.
+	snapshot_cache *snapshots{nullptr};
+	std::unique_ptr<tab_overview> overview{std::make_unique<tab_overview>()};
+	// Tabs shown by the overview, in the order of its items.
+	std::vector<slot_handle> overview_tabs;
+	// Tabs waiting to be opened by the idle callback.  Tabs restored
+	// from the session journal keep their journal id.
+	struct queued_tab {
+		std::string uri;
+		uint32_t session_id;
+	};
+	std::deque<queued_tab> uri_queue;
+	unsigned int uri_queue_source{0};
+	bool focus_queued{false};
+	// A hidden web_view which has already started its web process,
+	// without loading a page, given to the next materialized tab.
+	// Another is created at low priority once it is taken.
+	gtk::unique_ptr<webkit::web_view> spare_view;
+	unsigned int spare_source{0};
+	// Text of the URI entry and its top suggestion, which are prepared
+	// for by the speculator once typing pauses.
+	speculator spec;
+	// Memory and CPU use of each web_view's web process, and the
+	// throttling of the processes of hidden tabs.
+	process_monitor procs;
+	std::unique_ptr<process_throttler> throttle{std::make_unique<process_throttler>()};
+	std::string speculative_text;
+	std::string speculative_top;
+	unsigned int speculation_source{0};
+	// Handles of tabs by their notebook page, web_view and close button,
+	// the objects which emit each tab's signals, so a slot finds its tab
+	// without searching.  Updated whenever tabs are opened, closed,
+	// materialized or discarded.
+	std::unordered_map<const GtkWidget *, slot_handle> tab_by_page;
+	std::unordered_map<const webkit::web_view *, slot_handle> tab_by_view;
+	std::unordered_map<const gtk::button *, slot_handle> tab_by_close;
+	// Set once the window is being destroyed, after which notebook page
+	// switches no longer show (and materialize) tabs.
+	bool closing{false};
 	// Details about the currently shown page.
-	std::array<gtk::connection, 8> page_signals;
 	struct visable_tab {
-		unsigned int tab_index{0};
+		slot_handle tab;
 		webkit::web_view *web_view{nullptr};
 		WebKitBackForwardList *bfl{nullptr};
 		visable_tab() {}
-		visable_tab(unsigned int n, webkit::web_view& wv) :
-			tab_index{n}, web_view{&wv}, bfl{wv.get_back_forward_list()} {}
+		visable_tab(slot_handle tab, webkit::web_view& wv) :
+			tab{tab}, web_view{&wv}, bfl{wv.get_back_forward_list()} {}
 	} visable_tab;
 
 public:
 	// Constructors to create the toplevel browser window widget.  Multiple
 	// URIs (a "session") to open may be specified, while the default
-	// constructor will open a single tab to a single blank page.
+	// constructor will open a single tab to a single blank page.  Only
+	// the first tab of a session is opened by the constructor; the rest
+	// are queued with queue_uri.
+	//
+	// If a session journal is given, tab changes are recorded to it, and
+	// the tabs of the previous session are restored before any URIs
+	// from the session argument are opened.  Every web_view is created
+	// as described by the web_view_options, sharing their context and
+	// content filters.
 	browser() : browser{std::vector<const char *>{""}} {}
-	browser(const std::vector<const char *>&);
+	browser(const std::vector<const char *>&, session_journal * = nullptr,
+		const web_view_options& = {});
 
 	// open_new_tab creates a new tab, loading the specified resource, and
 	// adds it to the browser, appending the page to the end of the
@@ -79,16 +244,91 @@ public:
 	// view to the newly opened tab.
 	int open_new_tab(const char *);
 
+	// queue_uri schedules a new tab to be opened for uri.  Queued tabs
+	// are opened in batches from an idle callback, so queueing any number
+	// of URIs does not block the main loop.  If the browser only shows a
+	// single blank page, the first queued URI is loaded there instead.
+	void queue_uri(std::string);
+
 	// show_window calls the show method of the browser's window widget.
 	void show_window();
 
+	// present raises the browser's window to the user, and switches to
+	// the next tab opened from the URI queue.
+	void present();
+
+	// set_discard_policy modifies when hidden tabs are discarded.
+	void set_discard_policy(const discard_policy&);
+
+	// set_history sets the history which records visits and provides
+	// suggestions for the URI entry.
+	void set_history(history&);
+
+	// set_text_index sets the index which records the text of each
+	// loaded page, and also provides suggestions for the URI entry.
+	void set_text_index(text_index&);
+
+	// set_cache_monitor sets the monitor which is told of each finished
+	// page load, to estimate how often resources are cached.
+	void set_cache_monitor(cache_monitor&);
+
+	// set_load_stats sets the stats which record the timing of every
+	// page load.
+	void set_load_stats(load_stats&);
+
+	// set_snapshot_cache sets the cache of tab thumbnails shown by the
+	// tab overview.  Without one, the overview shows only tab titles.
+	void set_snapshot_cache(snapshot_cache&);
+
+	// set_max_find_matches sets the number of matches of the page search
+	// counted and highlighted in each tab.
+	void set_max_find_matches(unsigned int);
+
+	// append_process_stats appends a line describing the web process
+	// memory and CPU use of each materialized tab.
+	void append_process_stats(std::string&) const;
+
+	// append_speculation_stats appends the speculator's counts of
+	// speculations made and used by typed navigations.
+	void append_speculation_stats(std::string&) const;
+
+	// benchmark opens, shows and closes each number of tabs in turn, all
+	// loading uri, timing every operation and sampling the memory used
+	// by this process, and returns the results as JSON.  Pending events
+	// are processed between operations, but loads are not waited for.
+	std::string benchmark(const std::vector<unsigned int>& counts, const char *uri);
+
 private:
-	void show_webview(unsigned int, webkit::web_view&);
-	void switch_page(unsigned int);
+	slot_handle open_tab(const char *, uint32_t session_id);
+	void queue_tab(std::string, uint32_t session_id);
+	webkit::web_view& materialize_tab(slot_handle);
+	gtk::unique_ptr<webkit::web_view> create_web_view();
+	gtk::unique_ptr<webkit::web_view> take_web_view();
+	void discard_tab(browser_tab&);
+	void forget_web_view(webkit::web_view&);
+	void throttle_tab(browser_tab&, gint64 now);
+	void apply_settings(const browser_tab&, webkit::web_view&, const char *uri);
+	void toggle_lightweight();
+	void discard_tabs();
+	void close_tab(slot_handle);
+	browser_tab *find_tab(const webkit::web_view&);
+	void show_webview(slot_handle, webkit::web_view&);
+	void switch_page(slot_handle);
+	void capture_snapshot(slot_handle);
+	void show_overview();
+	void update_overview();
+	void hide_overview();
+	void begin_page_search(bool all_tabs);
+	void search_pages();
+	void search_page(webkit::web_view&);
+	void update_search_status();
 	void update_histnav(webkit::web_view&);
+	void update_process_tooltips();
+	void export_har();
 
 	// Slots (member functions)
 	void on_nav_entry_activate(uri_entry&);
+	void on_nav_entry_changed(uri_entry&);
 	void on_notebook_switch_page(gtk::notebook&, gtk::widget&, unsigned int);
 	void on_notebook_page_added(gtk::notebook&, gtk::widget&, unsigned int);
 	void on_notebook_page_removed(gtk::notebook&, gtk::widget&, unsigned int);
@@ -101,68 +341,144 @@ private:
 	void on_fwd_button_clicked(gtk::button&);
 	void on_back_forward_list_changed(WebKitBackForwardList&, WebKitBackForwardListItem&,
 		gpointer);
+	void on_nav_entry_refresh_clicked(uri_entry&);
 	void on_web_view_load_changed(webkit::web_view&, WebKitLoadEvent);
+	bool on_web_view_decide_policy(webkit::web_view&, WebKitPolicyDecision&,
+		WebKitPolicyDecisionType);
+	void on_web_view_resource_load_started(webkit::web_view&, WebKitWebResource&,
+		WebKitURIRequest&);
 	void on_web_view_notify_uri(webkit::web_view&, GParamSpec&);
 	void on_web_view_notify_title(webkit::web_view&, GParamSpec&);
 	void on_page_search_changed(gtk::search_entry&);
+	bool on_page_search_timeout();
+	void on_find_counted_matches(webkit::find_controller&, unsigned int);
+	bool on_discard_timeout();
+	bool on_uri_queue_idle();
+	bool on_spare_idle();
+	bool on_process_timeout();
+	bool on_speculation_timeout();
 
 	// Slots (static functions)
 	static void on_nav_entry_activate(uri_entry *entry, browser *b) {
+		slot_timer t{"browser::on_nav_entry_activate"};
 		return b->on_nav_entry_activate(*entry);
 	}
+	static void on_nav_entry_changed(uri_entry *entry, browser *b) {
+		slot_timer t{"browser::on_nav_entry_changed"};
+		return b->on_nav_entry_changed(*entry);
+	}
 	static void on_notebook_switch_page(gtk::notebook *notebook, gtk::widget *widget,
 		unsigned int page_num, browser *b) {
+		slot_timer t{"browser::on_notebook_switch_page"};
 		b->on_notebook_switch_page(*notebook, *widget, page_num);
 	}
 	static void on_notebook_page_added(gtk::notebook *notebook, gtk::widget *widget,
 		unsigned int page_num, browser *b) {
+		slot_timer t{"browser::on_notebook_page_added"};
 		b->on_notebook_page_added(*notebook, *widget, page_num);
 	}
 	static void on_notebook_page_removed(gtk::notebook *notebook, gtk::widget *widget,
 		unsigned int page_num, browser *b) {
+		slot_timer t{"browser::on_notebook_page_removed"};
 		b->on_notebook_page_removed(*notebook, *widget, page_num);
 	}
 	static void on_notebook_page_reordered(gtk::notebook *notebook, gtk::widget *child,
 		unsigned int page_num, browser *b) {
+		slot_timer t{"browser::on_notebook_page_reordered"};
 		b->on_notebook_page_reordered(*notebook, *child, page_num);
 	}
 	static void on_new_tab_clicked(gtk::button *button, browser *b) {
+		slot_timer t{"browser::on_new_tab_clicked"};
 		b->on_new_tab_clicked(*button);
 	}
 	static bool on_window_key_press_event(gtk::window *w, GdkEventKey *ev, browser *b) {
+		slot_timer t{"browser::on_window_key_press_event"};
 		return b->on_window_key_press_event(*w, *ev);
 	}
 	static void on_window_destroy(gtk::window *w, browser *b) {
+		slot_timer t{"browser::on_window_destroy"};
 		return b->on_window_destroy(*w);
 	}
 	static void on_tab_close_clicked(gtk::button *button, browser *b) {
+		slot_timer t{"browser::on_tab_close_clicked"};
 		b->on_tab_close_clicked(*button);
 	}
 	static void on_back_button_clicked(gtk::button *button, browser *b) {
+		slot_timer t{"browser::on_back_button_clicked"};
 		b->on_back_button_clicked(*button);
 	}
 	static void on_fwd_button_clicked(gtk::button *button, browser *b) {
+		slot_timer t{"browser::on_fwd_button_clicked"};
 		b->on_fwd_button_clicked(*button);
 	}
 	static void on_back_forward_list_changed(WebKitBackForwardList *button,
 		WebKitBackForwardListItem *item_added, gpointer items_removed, browser *b) {
+		slot_timer t{"browser::on_back_forward_list_changed"};
 		b->on_back_forward_list_changed(*button, *item_added, items_removed);
 	}
+	static void on_nav_entry_refresh_clicked(uri_entry *entry, browser *b) {
+		slot_timer t{"browser::on_nav_entry_refresh_clicked"};
+		b->on_nav_entry_refresh_clicked(*entry);
+	}
 	static void on_web_view_load_changed(webkit::web_view *web_view,
 		WebKitLoadEvent load_event, browser *b) {
+		slot_timer t{"browser::on_web_view_load_changed"};
 		b->on_web_view_load_changed(*web_view, load_event);
 	}
+	static gboolean on_web_view_decide_policy(webkit::web_view *web_view,
+		WebKitPolicyDecision *decision, WebKitPolicyDecisionType type, browser *b) {
+		slot_timer t{"browser::on_web_view_decide_policy"};
+		return b->on_web_view_decide_policy(*web_view, *decision, type);
+	}
+	static void on_web_view_resource_load_started(webkit::web_view *web_view,
+		WebKitWebResource *resource, WebKitURIRequest *request, browser *b) {
+		slot_timer t{"browser::on_web_view_resource_load_started"};
+		b->on_web_view_resource_load_started(*web_view, *resource, *request);
+	}
 	static void on_web_view_notify_uri(webkit::web_view *web_view,
 		GParamSpec *param_spec, browser *b) {
+		slot_timer t{"browser::on_web_view_notify_uri"};
 		b->on_web_view_notify_uri(*web_view, *param_spec);
 	}
 	static void on_web_view_notify_title(webkit::web_view *web_view,
 		GParamSpec *param_spec, browser *b) {
+		slot_timer t{"browser::on_web_view_notify_title"};
 		b->on_web_view_notify_title(*web_view, *param_spec);
 	}
 	static void on_page_search_changed(gtk::search_entry *entry, browser *b) {
+		slot_timer t{"browser::on_page_search_changed"};
 		b->on_page_search_changed(*entry);
 	}
+	static gboolean on_page_search_timeout(browser *b) {
+		slot_timer t{"browser::on_page_search_timeout"};
+		return b->on_page_search_timeout();
+	}
+	static void on_find_counted_matches(webkit::find_controller *fc,
+		unsigned int match_count, browser *b) {
+
+		slot_timer t{"browser::on_find_counted_matches"};
+		b->on_find_counted_matches(*fc, match_count);
+	}
+	static gboolean on_discard_timeout(browser *b) {
+		slot_timer t{"browser::on_discard_timeout"};
+		return b->on_discard_timeout();
+	}
+	static gboolean on_uri_queue_idle(browser *b) {
+		slot_timer t{"browser::on_uri_queue_idle"};
+		return b->on_uri_queue_idle();
+	}
+	static gboolean on_spare_idle(browser *b) {
+		slot_timer t{"browser::on_spare_idle"};
+		return b->on_spare_idle();
+	}
+	static gboolean on_process_timeout(browser *b) {
+		slot_timer t{"browser::on_process_timeout"};
+		return b->on_process_timeout();
+	}
+	static gboolean on_speculation_timeout(browser *b) {
+		slot_timer t{"browser::on_speculation_timeout"};
+		return b->on_speculation_timeout();
+	}
 };
 
 } // namespace volo
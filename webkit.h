@@ -5,6 +5,7 @@
 #ifndef _WEBKIT_H
 #define _WEBKIT_H
 
+#include <memory>
 #include <string>
 
 #include <webkit2/webkit2.h>
@@ -14,9 +15,34 @@
 namespace webkit {
 
 struct find_controller;
+struct web_view;
+struct website_data_manager;
+
+struct session_state_unref {
+	void operator()(WebKitWebViewSessionState *state) const {
+		webkit_web_view_session_state_unref(state);
+	}
+};
+
+// session_state owns a reference to a snapshot of a web_view's session
+// (its back forward list, including scroll positions and form data).
+using session_state = std::unique_ptr<WebKitWebViewSessionState, session_state_unref>;
 
 namespace methods {
 
+template <class T, class Derived>
+struct website_data_manager : gtk::methods::gobject<T, Derived> {
+	using c_type = WebKitWebsiteDataManager;
+
+	const char * get_disk_cache_directory() const {
+		return webkit_website_data_manager_get_disk_cache_directory(ptr());
+	}
+
+	c_type * ptr() const {
+		return const_cast<c_type *>(reinterpret_cast<const c_type *>(this));
+	}
+};
+
 template <class T, class Derived>
 struct web_context : gtk::methods::gobject<T, Derived> {
 	using c_type = WebKitWebContext;
@@ -35,6 +61,98 @@ struct web_context : gtk::methods::gobject<T, Derived> {
 		webkit_web_context_set_process_model(ptr(), model);
 	}
 
+	// set_cache_model sets how much memory and disk web_views may use
+	// to cache resources.  WEBKIT_CACHE_MODEL_WEB_BROWSER caches the
+	// most, allowing fast back and forward navigation and revisits.
+	void set_cache_model(WebKitCacheModel model) {
+		webkit_web_context_set_cache_model(ptr(), model);
+	}
+
+	webkit::website_data_manager * get_website_data_manager() const {
+		return reinterpret_cast<webkit::website_data_manager *>(
+			webkit_web_context_get_website_data_manager(ptr()));
+	}
+
+	// prefetch_dns resolves hostname in the background, so that a later
+	// load from the host does not wait for the lookup.
+	void prefetch_dns(const char *hostname) {
+		webkit_web_context_prefetch_dns(ptr(), hostname);
+	}
+
+	// set_network_proxy_settings sets the proxies used by every web_view
+	// of the context.  Custom settings are copied, and unused by the
+	// other modes.
+	void set_network_proxy_settings(WebKitNetworkProxyMode mode,
+		WebKitNetworkProxySettings *settings = nullptr) {
+
+		webkit_web_context_set_network_proxy_settings(ptr(), mode, settings);
+	}
+
+	c_type * ptr() const {
+		return const_cast<c_type *>(reinterpret_cast<const c_type *>(this));
+	}
+};
+
+template <class T, class Derived>
+struct user_content_manager : gtk::methods::gobject<T, Derived> {
+	using c_type = WebKitUserContentManager;
+
+	// add_filter applies a compiled content filter to all web_views
+	// using the manager, including those already loaded.
+	void add_filter(WebKitUserContentFilter& filter) {
+		webkit_user_content_manager_add_filter(ptr(), &filter);
+	}
+
+	void remove_all_filters() {
+		webkit_user_content_manager_remove_all_filters(ptr());
+	}
+
+	c_type * ptr() const {
+		return const_cast<c_type *>(reinterpret_cast<const c_type *>(this));
+	}
+};
+
+template <class T, class Derived>
+struct settings : gtk::methods::gobject<T, Derived> {
+	using c_type = WebKitSettings;
+
+	// set_enable_javascript_markup enables or disables the scripts of
+	// pages (script elements, event handler attributes and javascript:
+	// URIs), while scripts run by the browser itself still run.
+	void set_enable_javascript_markup(bool enabled) {
+		webkit_settings_set_enable_javascript_markup(ptr(), enabled);
+	}
+
+	void set_auto_load_images(bool enabled) {
+		webkit_settings_set_auto_load_images(ptr(), enabled);
+	}
+
+	void set_enable_webgl(bool enabled) {
+		webkit_settings_set_enable_webgl(ptr(), enabled);
+	}
+
+	void set_enable_media(bool enabled) {
+		webkit_settings_set_enable_media(ptr(), enabled);
+	}
+
+	void set_enable_mediasource(bool enabled) {
+		webkit_settings_set_enable_mediasource(ptr(), enabled);
+	}
+
+	void set_enable_webaudio(bool enabled) {
+		webkit_settings_set_enable_webaudio(ptr(), enabled);
+	}
+
+	void set_media_playback_requires_user_gesture(bool required) {
+		webkit_settings_set_media_playback_requires_user_gesture(ptr(), required);
+	}
+
+	// set_user_agent sets the User-Agent header and navigator.userAgent,
+	// or restores the default user agent if ua is null or empty.
+	void set_user_agent(const char *ua) {
+		webkit_settings_set_user_agent(ptr(), ua);
+	}
+
 	c_type * ptr() const {
 		return const_cast<c_type *>(reinterpret_cast<const c_type *>(this));
 	}
@@ -97,12 +215,84 @@ struct web_view : gtk::methods::widget<T, Derived> {
 		return webkit_web_view_get_back_forward_list(ptr());
 	}
 
+	// set_settings replaces the web_view's settings, which may be shared
+	// with other web_views.  Pages already loaded keep the settings they
+	// were loaded with until reloaded.
+	template <class U, class UDerived>
+	void set_settings(settings<U, UDerived>& s) {
+		webkit_web_view_set_settings(ptr(), s.ptr());
+	}
+
 	find_controller * get_find_controller() const {
 		return reinterpret_cast<find_controller *>(
 			webkit_web_view_get_find_controller(ptr())
 		);
 	}
 
+	// go_to_back_forward_list_item loads the history item described by
+	// item.  item must belong to the web_view's back forward list.
+	void go_to_back_forward_list_item(WebKitBackForwardListItem& item) {
+		webkit_web_view_go_to_back_forward_list_item(ptr(), &item);
+	}
+
+	// get_session_state returns a snapshot of the web_view's current
+	// session state.
+	session_state get_session_state() const {
+		return session_state{webkit_web_view_get_session_state(ptr())};
+	}
+
+	// restore_session_state replaces the web_view's back forward list
+	// with the one saved in state.  No page is loaded; the current item
+	// of the restored list must be loaded by the caller.
+	void restore_session_state(WebKitWebViewSessionState& state) {
+		webkit_web_view_restore_session_state(ptr(), &state);
+	}
+
+	// get_main_resource returns the resource of the page loaded in the
+	// main frame, or null if nothing has been loaded.  It is owned by the
+	// web_view.
+	WebKitWebResource * get_main_resource() const {
+		return webkit_web_view_get_main_resource(ptr());
+	}
+
+	// is_playing_audio returns whether the web_view is currently
+	// playing any audio.
+	bool is_playing_audio() const {
+		return webkit_web_view_is_playing_audio(ptr());
+	}
+
+	// run_javascript runs script in the main frame of the loaded page,
+	// ignoring any result.
+	void run_javascript(const std::string& script) {
+		webkit_web_view_run_javascript(ptr(), script.c_str(), nullptr, nullptr, nullptr);
+	}
+
+	// run_javascript runs script as above, calling callback once it
+	// has finished.  The callback retrieves the result with
+	// webkit_web_view_run_javascript_finish.
+	void run_javascript(const char *script, GAsyncReadyCallback callback, gpointer data) {
+		webkit_web_view_run_javascript(ptr(), script, nullptr, callback, data);
+	}
+
+	// run_javascript_in_world runs script as above, in the isolated
+	// script world named world_name, where the page's own scripts cannot
+	// change the built-in objects or DOM bindings it uses.  The callback
+	// retrieves the result with webkit_web_view_run_javascript_in_world_finish.
+	void run_javascript_in_world(const char *script, const char *world_name,
+		GAsyncReadyCallback callback, gpointer data) {
+
+		webkit_web_view_run_javascript_in_world(ptr(), script, world_name,
+			nullptr, callback, data);
+	}
+
+	// get_snapshot draws the visible region of the page, calling
+	// callback once it has finished.  The callback retrieves the image
+	// surface with webkit_web_view_get_snapshot_finish.
+	void get_snapshot(GAsyncReadyCallback callback, gpointer data) {
+		webkit_web_view_get_snapshot(ptr(), WEBKIT_SNAPSHOT_REGION_VISIBLE,
+			WEBKIT_SNAPSHOT_OPTIONS_NONE, nullptr, callback, data);
+	}
+
 	bool get_tls_info(GTlsCertificate *& certificate, GTlsCertificateFlags& errors) const {
 		return webkit_web_view_get_tls_info(ptr(), &certificate, &errors);
 	}
@@ -126,6 +316,22 @@ struct web_view : gtk::methods::widget<T, Derived> {
 		return this->connect("load-changed", G_CALLBACK(slot), &obj);
 	}
 
+	template <class U>
+	using resource_load_started_slot = void (*)(Derived *, WebKitWebResource *,
+		WebKitURIRequest *, U *);
+	template <class U>
+	gtk::connection connect_resource_load_started(U& obj, resource_load_started_slot<U> slot) {
+		return this->connect("resource-load-started", G_CALLBACK(slot), &obj);
+	}
+
+	template <class U>
+	using decide_policy_slot = gboolean (*)(Derived *, WebKitPolicyDecision *,
+		WebKitPolicyDecisionType, U *);
+	template <class U>
+	gtk::connection connect_decide_policy(U& obj, decide_policy_slot<U> slot) {
+		return this->connect("decide-policy", G_CALLBACK(slot), &obj);
+	}
+
 	template <class U>
 	using notify_title_slot = void (*)(Derived *, GParamSpec *, U *);
 	template <class U>
@@ -165,6 +371,35 @@ struct find_controller : gtk::methods::gobject<T, Derived> {
 		webkit_find_controller_search_finish(ptr());
 	}
 
+	// count_matches counts the matches of search_text without
+	// highlighting them, emitting counted-matches once counted.  Counts
+	// above max_match_count are reported as G_MAXUINT.
+	void count_matches(const char *search_text, uint32_t find_options = default_find_options,
+		unsigned int max_match_count = default_max_matches) {
+		webkit_find_controller_count_matches(ptr(), search_text, find_options,
+			max_match_count);
+	}
+
+	webkit::web_view * get_web_view() {
+		return reinterpret_cast<webkit::web_view *>(
+			webkit_find_controller_get_web_view(ptr()));
+	}
+
+	// get_search_text returns the text last searched for or counted, or
+	// null.
+	const char * get_search_text() {
+		return webkit_find_controller_get_search_text(ptr());
+	}
+
+	// Signals.
+
+	template <class U>
+	using counted_matches_slot = void (*)(Derived *, unsigned int, U *);
+	template <class U>
+	gtk::connection connect_counted_matches(U& obj, counted_matches_slot<U> slot) {
+		return this->connect("counted-matches", G_CALLBACK(slot), &obj);
+	}
+
 	c_type * ptr() {
 		return const_cast<c_type *>(reinterpret_cast<const c_type *>(this));
 	}
@@ -172,14 +407,47 @@ struct find_controller : gtk::methods::gobject<T, Derived> {
 
 } // namespace methods
 
+struct website_data_manager : methods::website_data_manager<WebKitWebsiteDataManager,
+	website_data_manager> {
+
+	// create returns a data manager which stores the disk cache in
+	// disk_cache_dir, or in the default location if it is null, and all
+	// other data in the default locations.
+	static auto create(const char *disk_cache_dir) {
+		return reinterpret_cast<website_data_manager *>(
+			webkit_website_data_manager_new("disk-cache-directory", disk_cache_dir, nullptr));
+	}
+};
+
 struct web_context : methods::web_context<WebKitWebContext, web_context> {
 	// get_default returns the wrapped default WebKitWebContext.
-	// Non-default web_contexts may be representable in later versions
-	// of WebKitGTK, but as of 2.6, it appears that only the default context
-	// ever exists.
 	static auto get_default() {
 		return reinterpret_cast<web_context *>(webkit_web_context_get_default());
 	}
+
+	// create returns a new web context storing website data with
+	// manager.  Its settings are independent of the default context,
+	// and web_views must be created with it explicitly.
+	static auto create(website_data_manager& manager) {
+		return reinterpret_cast<web_context *>(
+			webkit_web_context_new_with_website_data_manager(manager.ptr()));
+	}
+};
+
+struct user_content_manager : methods::user_content_manager<WebKitUserContentManager,
+	user_content_manager> {
+
+	static auto create() {
+		return reinterpret_cast<user_content_manager *>(webkit_user_content_manager_new());
+	}
+};
+
+struct settings : methods::settings<WebKitSettings, settings> {
+	// create returns settings with WebKit's defaults.  The settings are
+	// owned by the caller, and are not floating.
+	static auto create() {
+		return reinterpret_cast<settings *>(webkit_settings_new());
+	}
 };
 
 struct web_view : methods::web_view<WebKitWebView, web_view> {
@@ -187,6 +455,23 @@ struct web_view : methods::web_view<WebKitWebView, web_view> {
 		return reinterpret_cast<web_view *>(webkit_web_view_new());
 	}
 
+	// create returns a web_view in context, whose scripts, style
+	// sheets and content filters are those of manager.  The default
+	// context, or a new manager, is used for either that is null.
+	static auto create(web_context *context, user_content_manager *manager) {
+		return reinterpret_cast<web_view *>(g_object_new(WEBKIT_TYPE_WEB_VIEW,
+			"web-context", context ? context->ptr() : nullptr,
+			"user-content-manager", manager ? manager->ptr() : nullptr,
+			nullptr));
+	}
+	static auto create(web_context *context, user_content_manager *manager,
+		const std::string& uri) {
+
+		auto ptr = create(context, manager);
+		ptr->load_uri(uri);
+		return ptr;
+	}
+
 	static auto create(const char *uri) {
 		auto ptr = create();
 		ptr->load_uri(uri);